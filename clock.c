@@ -1,6 +1,6 @@
 /* 
- * clock.c - Routines for using the cycle counters on x86, 
- *           Alpha, and Sparc boxes.
+ * clock.c - Routines for using the cycle counters on x86, x86-64,
+ *           AArch64, Alpha, and Sparc boxes.
  * 
  * Copyright (c) 2002, R. Bryant and D. O'Hallaron, All rights reserved.
  * May not be used, modified, or copied without permission.
@@ -9,6 +9,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <time.h>
 #include <sys/times.h>
 #include "clock.h"
 
@@ -16,7 +17,7 @@
 /******************************************************* 
  * Machine dependent functions 
  *
- * Note: the constants __i386__ and  __alpha
+ * Note: the constants __i386__, __x86_64__, __aarch64__ and __alpha
  * are set by GCC when it calls the C preprocessor
  * You can verify this for yourself using gcc -v.
  *******************************************************/
@@ -71,6 +72,81 @@ double get_counter()
 }
 /* $end x86cyclecounter */
 
+#elif defined(__x86_64__)
+/*******************************************************
+ * x86-64 versions of start_counter() and get_counter()
+ *******************************************************/
+
+static unsigned long long cyc_start = 0;
+
+/* 
+ * Read the time stamp counter at the start of a measurement. The 
+ * lfence keeps rdtsc from executing before the instructions ahead 
+ * of it have completed.
+ */
+static inline unsigned long long read_counter_start(void)
+{
+    unsigned hi, lo;
+    asm volatile("lfence; rdtsc" : "=a" (lo), "=d" (hi) : : "memory");
+    return ((unsigned long long)hi << 32) | lo;
+}
+
+/* 
+ * Read the time stamp counter at the end of a measurement. rdtscp 
+ * waits for the measured code to finish, and the lfence keeps the 
+ * code after it from starting early.
+ */
+static inline unsigned long long read_counter_end(void)
+{
+    unsigned hi, lo, aux;
+    asm volatile("rdtscp; lfence" : "=a" (lo), "=d" (hi), "=c" (aux) : : "memory");
+    return ((unsigned long long)hi << 32) | lo;
+}
+
+/* Record the current value of the cycle counter. */
+void start_counter()
+{
+    cyc_start = read_counter_start();
+}
+
+/* Return the number of cycles since the last call to start_counter. */
+double get_counter()
+{
+    return (double)(read_counter_end() - cyc_start);
+}
+
+#elif defined(__aarch64__)
+/*******************************************************
+ * AArch64 versions of start_counter() and get_counter()
+ *
+ * These read the virtual counter cntvct_el0, which ticks at a fixed
+ * rate (cntfrq_el0) rather than at the cpu clock. Every "cycle" below
+ * is one tick of that counter, and mhz() measures the tick rate, so
+ * cycles/mhz still gives seconds.
+ *******************************************************/
+
+static unsigned long long cyc_start = 0;
+
+/* Read the virtual counter; the isb keeps it in program order */
+static inline unsigned long long read_counter(void)
+{
+    unsigned long long val;
+    asm volatile("isb; mrs %0, cntvct_el0" : "=r" (val) : : "memory");
+    return val;
+}
+
+/* Record the current value of the cycle counter. */
+void start_counter()
+{
+    cyc_start = read_counter();
+}
+
+/* Return the number of cycles since the last call to start_counter. */
+double get_counter()
+{
+    return (double)(read_counter() - cyc_start);
+}
+
 #elif defined(__alpha)
 
 /****************************************************
@@ -179,58 +255,101 @@ double ovhd()
     return result;
 }
 
+/* Return the monotonic clock in seconds */
+static double mono_secs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* 
+ * Estimate the clock rate by counting the cycles that elapse while 
+ * spinning for secs seconds. The interval is measured with the
+ * monotonic clock rather than assumed from a sleep, so a short 
+ * interval is enough.
+ */
+static double calibrate_mhz(double secs)
+{
+    double t0, t1, cycles;
+
+    t0 = mono_secs();
+    start_counter();
+    do {
+	t1 = mono_secs();
+    } while (t1 - t0 < secs);
+    cycles = get_counter();
+    t1 = mono_secs();
+    return cycles / (1e6*(t1 - t0));
+}
+
 /* $begin mhz */
 /* Estimate the clock rate by measuring the cycles that elapse */ 
-/* while sleeping for sleeptime seconds */
+/* during sleeptime seconds */
 double mhz_full(int verbose, int sleeptime)
 {
     double rate;
 
-    start_counter();
-    sleep(sleeptime);
-    rate = get_counter() / (1e6*sleeptime);
+    rate = calibrate_mhz((double)sleeptime);
     if (verbose) 
 	printf("Processor clock rate ~= %.1f MHz\n", rate);
     return rate;
 }
 /* $end mhz */
 
-/* Version using a default sleeptime */
+/* Version using a default calibration time of 0.25 seconds */
 double mhz(int verbose)
 {
-    return mhz_full(verbose, 2);
+    double rate;
+
+    rate = calibrate_mhz(0.25);
+    if (verbose) 
+	printf("Processor clock rate ~= %.1f MHz\n", rate);
+    return rate;
 }
 
 /** Special counters that compensate for timer interrupt overhead */
 
 static double cyc_per_tick = 0.0;
+static int callibrated = 0;
 
 #define NEVENT 100
-#define THRESHOLD 1000
-#define RECORDTHRESH 3000
+#define THRESHOLD 1.0       /* gaps of at least 1 us may be interrupts */
+#define RECORDTHRESH 3.0    /* ... and interrupts take at least 3 us */
+#define MAXCALLIBRATE 2.0   /* spend at most 2 s looking for them */
 
-/* Attempt to see how much time is used by timer interrupt */
+/* 
+ * Attempt to see how much time is used by timer interrupt. The 
+ * thresholds are in microseconds and converted to counter cycles
+ * with the measured clock rate, so they work for fast cpu clocks as
+ * well as for slow fixed-rate counters.
+ */
 static void callibrate(int verbose)
 {
-    double oldt;
+    double oldt, threshold, recordthresh, start;
     struct tms t;
     clock_t oldc;
     int e = 0;
 
+    threshold = THRESHOLD * calibrate_mhz(0.05);
+    recordthresh = RECORDTHRESH * threshold / THRESHOLD;
+    start = mono_secs();
+
     times(&t);
     oldc = t.tms_utime;
     start_counter();
     oldt = get_counter();
-    while (e <NEVENT) {
+    while (e <NEVENT && mono_secs() - start < MAXCALLIBRATE) {
 	double newt = get_counter();
 
-	if (newt-oldt >= THRESHOLD) {
+	if (newt-oldt >= threshold) {
 	    clock_t newc;
 	    times(&t);
 	    newc = t.tms_utime;
 	    if (newc > oldc) {
 		double cpt = (newt-oldt)/(newc-oldc);
-		if ((cyc_per_tick == 0.0 || cyc_per_tick > cpt) && cpt > RECORDTHRESH)
+		if ((cyc_per_tick == 0.0 || cyc_per_tick > cpt) && cpt > recordthresh)
 		    cyc_per_tick = cpt;
 		/*
 		  if (verbose)
@@ -253,8 +372,10 @@ void start_comp_counter()
 {
     struct tms t;
 
-    if (cyc_per_tick == 0.0)
+    if (!callibrated) {
 	callibrate(0);
+	callibrated = 1;
+    }
     times(&t);
     start_tick = t.tms_utime;
     start_counter();
@@ -52,10 +52,23 @@
   */
 #define UTIL_WEIGHT .60
 
+/*
+ * These constants decide when mdriver --baseline reports a regression:
+ * when a trace's utilization drops by more than REGRESS_UTIL, or its
+ * throughput drops by more than the fraction REGRESS_THRU and by more 
+ * than the measurement noise (the combined confidence intervals).
+ */
+#define REGRESS_UTIL 0.005   /* half a percentage point */
+#define REGRESS_THRU 0.02    /* 2 percent */
+
 /* 
- * Alignment requirement in bytes (either 4 or 8) 
+ * Alignment requirement in bytes: 8, or a larger power of two such as
+ * 16, 32 or 64 for SIMD and cache-line aligned payloads. Set it at
+ * build time with "make clean; make ALIGN=32".
  */
+#ifndef ALIGNMENT
 #define ALIGNMENT 8  
+#endif
 
 /* 
  * Maximum heap size in bytes 
@@ -65,8 +78,9 @@
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
  *****************************************************************************/
-#define USE_FCYC   0   /* cycle counter w/K-best scheme (x86 & Alpha only) */
+#define USE_FCYC   0   /* cycle counter w/K-best scheme (x86, x86-64, AArch64 & Alpha only) */
 #define USE_ITIMER 0   /* interval timer (any Unix box) */
-#define USE_GETTOD 1   /* gettimeofday (any Unix box) */
+#define USE_GETTOD 0   /* gettimeofday (any Unix box) */
+#define USE_CLOCK  1   /* monotonic clock w/warmup, K-best & conf. interval */
 
 #endif /* __CONFIG_H */
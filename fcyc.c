@@ -123,6 +123,14 @@ static void clear()
     sink = x;
 }
 
+/*
+ * fcyc_clear - Clear the cache, for other timers that want to
+ */
+void fcyc_clear(void)
+{
+    clear();
+}
+
 /*
  * fcyc - Use K-best scheme to estimate the running time of function f
  */
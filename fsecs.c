@@ -9,6 +9,7 @@
 #include "config.h"
 
 static double Mhz;  /* estimated CPU clock frequency */
+static double ci;   /* relative uncertainty of the last fsecs estimate */
 
 extern int verbose; /* -v option in mdriver.c */
 
@@ -36,6 +37,19 @@ void init_fsecs(void)
 #elif USE_GETTOD
     if (verbose)
 	printf("Measuring performance with gettimeofday().\n");
+#elif USE_CLOCK
+    if (verbose)
+	printf("Measuring performance with the monotonic clock.\n");
+
+    /* set key parameters for ftimer_clock */
+    set_ftimer_warmup(2);
+    set_ftimer_reps(5, 50);
+    set_ftimer_budget(2.0);
+    set_ftimer_k(3);
+    set_ftimer_median(0);
+    set_ftimer_epsilon(0.01);
+    set_ftimer_clear_cache(0);
+    set_ftimer_pin(1);
 #endif
 }
 
@@ -51,7 +65,23 @@ double fsecs(fsecs_test_funct f, void *argp)
     return ftimer_itimer(f, argp, 10);
 #elif USE_GETTOD
     return ftimer_gettod(f, argp, 10);
+#elif USE_CLOCK
+    ftimer_stats_t st;
+    ftimer_clock(f, argp, &st);
+    ci = (st.est > 0) ? st.spread / st.est : 0;
+    return st.est;
 #endif 
 }
 
+/*
+ * fsecs_ci - Return how far the last fsecs estimate may be off, relative
+ *     to the estimate: the spread of the K best runs for the K-best
+ *     minimum, the 95% confidence interval of the mean for the median
+ *     (0 if the timing method doesn't provide one)
+ */
+double fsecs_ci(void)
+{
+    return ci;
+}
+
 
@@ -7,14 +7,44 @@
  * Function timers that estimate the running time (in seconds) of a function f.
  *    ftimer_itimer: version that uses the interval timer
  *    ftimer_gettod: version that uses gettimeofday
+ *    ftimer_clock:  version that uses the monotonic clock, with warmup,
+ *                   adaptive repetitions and a confidence interval
  */
+#define _GNU_SOURCE /* for sched_getcpu and CPU_SET */
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sched.h>
+#include <time.h>
 #include <sys/time.h>
 #include "ftimer.h"
+#include "fcyc.h"
+
+/* Default values for ftimer_clock */
+#define WARMUP 2           /* untimed runs before measuring */
+#define MINREPS 5          /* always do at least MINREPS timed runs */
+#define MAXREPS 50         /* give up after MAXREPS timed runs */
+#define BUDGET 2.0         /* ... or after BUDGET seconds */
+#define K 3                /* value of K in K-best scheme */
+#define EPSILON 0.01       /* required precision of the estimate */
+
+static int warmup = WARMUP;
+static int minreps = MINREPS;
+static int maxreps = MAXREPS;
+static double budget = BUDGET;
+static int kbest = K;
+static int use_median = 0;
+static double epsilon = EPSILON;
+static int clear_cache = 0;
+static int pin = 1;
 
 /* function prototypes */
 static void init_etime(void);
 static double get_etime(void);
+static double clock_secs(void);
+static int cmp_double(const void *a, const void *b);
+static double t95(int df);
 
 /* 
  * ftimer_itimer - Use the interval timer to estimate the running time
@@ -53,6 +83,162 @@ double ftimer_gettod(ftimer_test_funct f, void *argp, int n)
 }
 
 
+/* 
+ * ftimer_clock - Use the monotonic clock to estimate the running time
+ * of f(argp). After the warmup runs, f is repeated until the K best
+ * runs agree within epsilon (or, for the median, until the 95%
+ * confidence interval of the mean is within epsilon of the mean), 
+ * or until MAXREPS runs or the time budget are used up. 
+ */
+double ftimer_clock(ftimer_test_funct f, void *argp, ftimer_stats_t *st)
+{
+    double *samples, *sorted;
+    double start, t, sum, sumsq, mean, var, sd, ci, est, spread;
+    cpu_set_t oldmask, mask;
+    int i, k, n, pinned = 0, done = 0;
+
+    if ((samples = malloc(2 * maxreps * sizeof(double))) == NULL) {
+	fprintf(stderr, "Fatal error.  Malloc returned null in ftimer_clock\n");
+	exit(1);
+    }
+    sorted = samples + maxreps;
+
+    /* Stay on one cpu while measuring so we don't pay for migrations */
+    if (pin && sched_getaffinity(0, sizeof(oldmask), &oldmask) == 0) {
+	CPU_ZERO(&mask);
+	CPU_SET(sched_getcpu(), &mask);
+	pinned = (sched_setaffinity(0, sizeof(mask), &mask) == 0);
+    }
+
+    for (i = 0; i < warmup; i++) 
+	f(argp);
+
+    n = 0;
+    sum = sumsq = mean = var = sd = ci = 0;
+    start = clock_secs();
+    while (!done) {
+	if (clear_cache)
+	    fcyc_clear();
+	t = clock_secs();
+	f(argp);
+	t = clock_secs() - t;
+	samples[n++] = t;
+	sum += t;
+	sumsq += t*t;
+
+	mean = sum / n;
+	var = (n > 1) ? (sumsq - n*mean*mean) / (n - 1) : 0;
+	sd = (var > 0) ? sqrt(var) : 0;  /* rounding makes it < 0 for equal samples */
+	ci = (n > 1) ? t95(n - 1) * sd / sqrt(n) : mean;
+
+	if (n < minreps)
+	    continue;
+	memcpy(sorted, samples, n * sizeof(double));
+	qsort(sorted, n, sizeof(double), cmp_double);
+	if (use_median)
+	    done = (ci <= epsilon * mean);
+	else
+	    done = (n >= kbest) && ((1 + epsilon)*sorted[0] >= sorted[kbest-1]);
+	done = done || (n == maxreps) || (clock_secs() - start > budget);
+    }
+    est = use_median ? 
+	((n % 2) ? sorted[n/2] : (sorted[n/2 - 1] + sorted[n/2]) / 2) :
+	sorted[0];
+
+    /* 
+     * How far the estimate itself can be off: the gap from the best to
+     * the Kth best run for the K-best minimum, the confidence interval of
+     * the mean for the median. One run tells us nothing (0).
+     */
+    k = (n < kbest) ? n : kbest;
+    spread = (n < 2) ? 0 : use_median ? ci : sorted[k-1] - sorted[0];
+
+    if (pinned)
+	sched_setaffinity(0, sizeof(oldmask), &oldmask);
+    free(samples);
+
+    if (st) {
+	st->est = est;
+	st->mean = mean;
+	st->stddev = sd;
+	st->ci = (n > 1) ? ci : 0;
+	st->spread = spread;
+	st->n = n;
+    }
+    return est;
+}
+
+/* return the monotonic clock in seconds */
+static double clock_secs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1E-9*ts.tv_nsec;
+}
+
+/* qsort comparison for doubles */
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* two-sided 95% quantile of Student's t with df degrees of freedom */
+static double t95(int df)
+{
+    static const double t[] = {
+	12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+	2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+	2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+    };
+    return (df <= 30) ? t[df-1] : 1.96;
+}
+
+/*
+ * Set the various parameters used by ftimer_clock
+ */
+void set_ftimer_warmup(int warmup_arg)
+{
+    warmup = warmup_arg;
+}
+
+void set_ftimer_reps(int minreps_arg, int maxreps_arg)
+{
+    minreps = (minreps_arg < 1) ? 1 : minreps_arg;
+    maxreps = (maxreps_arg < minreps) ? minreps : maxreps_arg;
+}
+
+void set_ftimer_budget(double secs)
+{
+    budget = secs;
+}
+
+void set_ftimer_k(int k)
+{
+    kbest = k;
+}
+
+void set_ftimer_median(int median)
+{
+    use_median = median;
+}
+
+void set_ftimer_epsilon(double epsilon_arg)
+{
+    epsilon = epsilon_arg;
+}
+
+void set_ftimer_clear_cache(int clear)
+{
+    clear_cache = clear;
+}
+
+void set_ftimer_pin(int pin_arg)
+{
+    pin = pin_arg;
+}
+
 /*
  * Routines for manipulating the Unix interval timer
  */
@@ -12,3 +12,54 @@ double ftimer_itimer(ftimer_test_funct f, void *argp, int n);
    Return the average of n runs */
 double ftimer_gettod(ftimer_test_funct f, void *argp, int n);
 
+/* Summary of the timed runs behind one ftimer_clock estimate */
+typedef struct {
+    double est;     /* the estimate: K-best minimum or median (secs) */
+    double mean;    /* mean of the timed runs (secs) */
+    double stddev;  /* standard deviation of the timed runs (secs) */
+    double ci;      /* half-width of the 95% confidence interval of the
+                       mean (secs, 0 with one run) */
+    double spread;  /* uncertainty of est: Kth best - best run (K-best),
+                       or ci (median); 0 with one run (secs) */
+    int n;          /* number of timed runs, not counting warmup */
+} ftimer_stats_t;
+
+/* Estimate the running time of f(argp) using the monotonic clock.
+   Runs f a few times to warm up, then repeats it until the estimate
+   is stable. Fills in *st (if not NULL) and returns st->est */
+double ftimer_clock(ftimer_test_funct f, void *argp, ftimer_stats_t *st);
+
+/*********************************************************
+ * Set the various parameters used by ftimer_clock
+ *********************************************************/
+
+/* Number of untimed runs before measuring. Default = 2 */
+void set_ftimer_warmup(int warmup);
+
+/* Minimum and maximum number of timed runs. Default = 5, 50 */
+void set_ftimer_reps(int minreps, int maxreps);
+
+/* Stop repeating after this many seconds, once minreps are done.
+   Default = 2.0 */
+void set_ftimer_budget(double secs);
+
+/* Value of K in the K-best scheme. Default = 3 */
+void set_ftimer_k(int k);
+
+/* When set, estimate with the median instead of the K-best minimum.
+   Default = 0 */
+void set_ftimer_median(int median);
+
+/* Tolerance: the K best runs must be within epsilon of each other 
+   (K-best), or the confidence interval within epsilon of the mean 
+   (median). Default = 0.01 */
+void set_ftimer_epsilon(double epsilon);
+
+/* When set, clear the cache with fcyc's clear() before every run.
+   Default = 0 */
+void set_ftimer_clear_cache(int clear);
+
+/* When set, pin the caller to its current cpu while measuring.
+   Default = 1 */
+void set_ftimer_pin(int pin);
+
@@ -0,0 +1,17 @@
+/*
+ * heapmap.h - format of the heap map files written by mdriver
+ *     (--map-at, --map-every) and read by mapview. Include mm.h first.
+ *
+ * A map file is a sequence of snapshots. Each snapshot is a
+ * heapmap_hdr_t followed by nblocks mm_mapent_t records, in the byte
+ * order of the machine that wrote them.
+ */
+
+#define HEAPMAP_MAGIC 0x50414d48 /* "HMAP" */
+
+typedef struct {
+    unsigned int magic;      /* HEAPMAP_MAGIC */
+    unsigned int op;         /* the snapshot was taken after this op */
+    unsigned int heap_bytes; /* mem_heapsize() at the time */
+    unsigned int nblocks;    /* number of mm_mapent_t records that follow */
+} heapmap_hdr_t;
@@ -0,0 +1,204 @@
+/*
+ * mapview.c - Render the heap maps that mdriver dumps with --map-at
+ *     and --map-every.
+ *
+ * By default each snapshot is drawn as rows of ASCII art, one character
+ * per (heap size / width) bytes of heap:
+ *
+ *     '#'  mostly allocated          '.'  mostly free
+ *     '+'  partly allocated          '!'  free block missing from the
+ *                                         free list, or an allocated
+ *                                         block found on it
+ *
+ * With -l every block is listed as "offset size state" instead.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "mm.h"
+#include "heapmap.h"
+
+#define WIDTH 64 /* default characters per row */
+#define ROWS  16 /* default rows per snapshot */
+
+/* Function prototypes */
+static void draw(heapmap_hdr_t *hdr, mm_mapent_t *map, int width, int rows);
+static void list(heapmap_hdr_t *hdr, mm_mapent_t *map);
+static void usage(void);
+
+int main(int argc, char **argv)
+{
+    FILE *fp;
+    heapmap_hdr_t hdr;
+    mm_mapent_t *map = NULL;
+    unsigned int max = 0;
+    int width = WIDTH, rows = ROWS;
+    int listing = 0, only = -1;
+    char c;
+
+    while ((c = getopt(argc, argv, "w:r:s:lh")) != EOF) {
+	switch (c) {
+	case 'w': /* Characters per row */
+	    width = atoi(optarg);
+	    break;
+	case 'r': /* Rows per snapshot */
+	    rows = atoi(optarg);
+	    break;
+	case 's': /* Only show the snapshot taken after this op */
+	    only = atoi(optarg);
+	    break;
+	case 'l': /* List the blocks instead of drawing them */
+	    listing = 1;
+	    break;
+	case 'h':
+	    usage();
+	    exit(0);
+	default:
+	    usage();
+	    exit(1);
+	}
+    }
+    if (optind != argc - 1 || width < 1 || rows < 1) {
+	usage();
+	exit(1);
+    }
+
+    if ((fp = fopen(argv[optind], "rb")) == NULL) {
+	perror(argv[optind]);
+	exit(1);
+    }
+
+    while (fread(&hdr, sizeof(hdr), 1, fp) == 1) {
+	if (hdr.magic != HEAPMAP_MAGIC) {
+	    fprintf(stderr, "%s: not a heap map\n", argv[optind]);
+	    exit(1);
+	}
+	if (hdr.nblocks > max) {
+	    max = hdr.nblocks;
+	    if ((map = realloc(map, max * sizeof(mm_mapent_t))) == NULL) {
+		perror("realloc");
+		exit(1);
+	    }
+	}
+	if (fread(map, sizeof(mm_mapent_t), hdr.nblocks, fp) != hdr.nblocks) {
+	    fprintf(stderr, "%s: truncated snapshot at op %u\n",
+		    argv[optind], hdr.op);
+	    exit(1);
+	}
+	if (only >= 0 && hdr.op != (unsigned int)only)
+	    continue;
+	if (listing)
+	    list(&hdr, map);
+	else
+	    draw(&hdr, map, width, rows);
+    }
+
+    fclose(fp);
+    free(map);
+    exit(0);
+}
+
+/*
+ * draw - Draw one snapshot as width x rows characters
+ */
+static void draw(heapmap_hdr_t *hdr, mm_mapent_t *map, int width, int rows)
+{
+    unsigned int i, cells = width * rows;
+    unsigned int alloc_bytes = 0, free_bytes = 0, nfree = 0;
+    double cellsize, start, end, lo, hi;
+    double *used = calloc(cells, sizeof(double));
+    char *bad = calloc(cells, 1);
+    unsigned int c, first, last;
+    int row, col, listed, alloc;
+
+    if (used == NULL || bad == NULL) {
+	perror("calloc");
+	exit(1);
+    }
+    cellsize = (double)hdr->heap_bytes / cells;
+
+    /* Spread each block over the cells it covers */
+    for (i = 0; i < hdr->nblocks; i++) {
+	alloc = map[i].info & MM_MAP_ALLOC;
+	listed = (map[i].info & MM_MAP_LISTED) != 0;
+	start = map[i].offset;
+	end = start + MM_MAP_SIZE(map[i]);
+	if (alloc)
+	    alloc_bytes += MM_MAP_SIZE(map[i]);
+	else {
+	    free_bytes += MM_MAP_SIZE(map[i]);
+	    nfree++;
+	}
+
+	first = start / cellsize;
+	last = (end - 1) / cellsize;
+	if (last >= cells)
+	    last = cells - 1;
+	for (c = first; c <= last; c++) {
+	    lo = start > c * cellsize ? start : c * cellsize;
+	    hi = end < (c+1) * cellsize ? end : (c+1) * cellsize;
+	    if (alloc)
+		used[c] += hi - lo;
+	    if (alloc == listed)
+		bad[c] = 1;
+	}
+    }
+
+    printf("op %u: heap %u bytes, %u blocks, %u allocated bytes, "
+	   "%u free bytes in %u blocks\n", hdr->op, hdr->heap_bytes,
+	   hdr->nblocks, alloc_bytes, free_bytes, nfree);
+    for (row = 0; row < rows; row++) {
+	printf("%10.0f |", row * width * cellsize);
+	for (col = 0; col < width; col++) {
+	    c = row * width + col;
+	    if (bad[c])
+		putchar('!');
+	    else if (used[c] >= 0.75 * cellsize)
+		putchar('#');
+	    else if (used[c] >= 0.25 * cellsize)
+		putchar('+');
+	    else
+		putchar('.');
+	}
+	printf("|\n");
+    }
+    printf("\n");
+    free(used);
+    free(bad);
+}
+
+/*
+ * list - Print one line per block of a snapshot
+ */
+static void list(heapmap_hdr_t *hdr, mm_mapent_t *map)
+{
+    unsigned int i;
+    int alloc, listed;
+
+    printf("op %u: heap %u bytes, %u blocks\n", hdr->op,
+	   hdr->heap_bytes, hdr->nblocks);
+    for (i = 0; i < hdr->nblocks; i++) {
+	alloc = map[i].info & MM_MAP_ALLOC;
+	listed = (map[i].info & MM_MAP_LISTED) != 0;
+	printf("%10u %8u %s%s\n", map[i].offset, MM_MAP_SIZE(map[i]),
+	       alloc ? "alloc" : "free",
+	       alloc == listed ? (alloc ? " (on free list!)" : " (not on free list!)") : "");
+    }
+    printf("\n");
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mapview [-hl] [-w <n>] [-r <n>] [-s <op>] <mapfile>\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-l         List the blocks instead of drawing the heap.\n");
+    fprintf(stderr, "\t-w <n>     Draw <n> characters per row (default %d).\n", WIDTH);
+    fprintf(stderr, "\t-r <n>     Draw <n> rows per snapshot (default %d).\n", ROWS);
+    fprintf(stderr, "\t-s <op>    Only show the snapshot taken after <op>.\n");
+}
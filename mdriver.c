@@ -7,18 +7,32 @@
  * Copyright (c) 2002, R. Bryant and D. O'Hallaron, All rights reserved.
  * May not be used, modified, or copied without permission.
  */
+#define _GNU_SOURCE /* for CPU_SET and pthread_setaffinity_np */
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <ctype.h>
 #include <assert.h>
 #include <float.h>
+#include <math.h>
 #include <time.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <signal.h>
+#include <sys/resource.h>
 
 #include "mm.h"
+#include "mm_buddy.h"
+#include "heapmap.h"
+#include "tracefmt.h"
 #include "memlib.h"
 #include "fsecs.h"
+#include "perfctr.h"
 #include "config.h"
 
 /**********************
@@ -30,8 +44,32 @@
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
 
+/* Long-only command line options */
+enum {OPT_JSON = 256, OPT_CSV, OPT_BASELINE, OPT_FRAG, OPT_FRAG_DIR,
+      OPT_MAP_AT, OPT_MAP_EVERY, OPT_MANIFEST, OPT_LATENCY, OPT_COLD,
+      OPT_PREFAULT, OPT_MLOCK, OPT_SITES, OPT_STEADY, OPT_PERSIST,
+      OPT_PROCS};
+
+/* Size classes for the live-object census: class k holds (2^(k-1), 2^k] */
+#define NCLASSES 32
+
+/* Replays of each trace for --latency; each op keeps its fastest time */
+#define LAT_RUNS 3
+
+/* --sites also times site profiling of one call in this many */
+#define SITE_SAMPLE 1000
+
+/* Forks timed from each --steady snapshot; the fastest is kept */
+#define STEADY_RUNS 9
+
+/* and a rest of fewer ops than this is too short to time */
+#define STEADY_MIN_OPS 1000
+
+/* --persist keeps the heap of this % of each trace in the heap file */
+#define PERSIST_PCT 50
+
 /* Returns true if p is ALIGNMENT-byte aligned */
-#define IS_ALIGNED(p)  ((((unsigned int)(p)) % ALIGNMENT) == 0)
+#define IS_ALIGNED(p)  ((((size_t)(p)) % ALIGNMENT) == 0)
 
 /****************************** 
  * The key compound data types 
@@ -46,9 +84,12 @@ typedef struct range_t {
 
 /* Characterizes a single trace operation (allocator request) */
 typedef struct {
-    enum {ALLOC, FREE, REALLOC} type; /* type of request */
+    enum {ALLOC, FREE, REALLOC,       /* type of request */
+	  REGION_NEW, REGION_ALLOC, REGION_RESET, REGION_FREE} type;
     int index;                        /* index for free() to use later */
     int size;                         /* byte size of alloc/realloc request */
+    int region;                       /* region id of a region request */
+    int site;                         /* call site of an alloc (0 = none) */
 } traceop_t;
 
 /* Holds the information for one trace file*/
@@ -56,10 +97,13 @@ typedef struct {
     int sugg_heapsize;   /* suggested heap size (unused) */
     int num_ids;         /* number of alloc/realloc ids */
     int num_ops;         /* number of distinct requests */
-    int weight;          /* weight for this trace (unused) */
+    int weight;          /* weight for this trace in the aggregate scores */
     traceop_t *ops;      /* array of requests */
     char **blocks;       /* array of ptrs returned by malloc/realloc... */
     size_t *block_sizes; /* ... and a corresponding array of payload sizes */
+    mm_region_t **regions; /* regions by region id, or NULL if none... */
+    int *reg_head;       /* ... the newest id allocated in each region ... */
+    int *reg_next;       /* ... and the id allocated before each one */
 } trace_t;
 
 /* 
@@ -72,16 +116,89 @@ typedef struct {
     range_t *ranges;
 } speed_t;
 
+/* One trace's results from a saved run, for --baseline */
+typedef struct {
+    char name[MAXLINE];  /* trace file name, without the directory */
+    int valid;           /* was the trace processed correctly? */
+    double util;         /* space utilization */
+    double kops;         /* throughput in Kops/sec */
+    double ci;           /* relative uncertainty of kops (fsecs_ci) */
+} baseline_t;
+
+/* One trace's weight and targets from a manifest (--manifest) */
+typedef struct {
+    double weight;       /* weight of the trace in the aggregate scores */
+    double util;         /* minimum space utilization (0 = no target) */
+    double kops;         /* minimum throughput in Kops/sec (0 = no target) */
+} target_t;
+
+/* An allocator that the driver can evaluate (-A) */
+typedef struct {
+    char *name;
+    int (*init)(void);
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+    void *(*realloc)(void *ptr, size_t size);
+    void (*heapstat)(mm_heapstat_t *st);
+    int (*heapmap)(mm_mapent_t *map, int max);
+    mm_region_t *(*region_create)(void);   /* NULL: no regions */
+    void *(*region_alloc)(mm_region_t *r, size_t size);
+    void (*region_reset)(mm_region_t *r);
+    void (*region_destroy)(mm_region_t *r);
+    void *(*malloc_site)(size_t size, unsigned int site); /* NULL: no sites */
+    void (*site_sample)(unsigned int every);
+    void (*site_dump)(FILE *fp, int top);
+    int (*sync)(void);                     /* NULL: no persistent heap */
+    unsigned int (*features)(void);        /* MM_* bits of the build */
+    void (*touch)(void);                   /* write its own state's pages */
+} allocator_t;
+
+/* Per-thread parameters and results for the multi-threaded replay (-T) */
+typedef struct {
+    trace_t *trace;              /* the ops this thread replays */
+    int *seq;                    /* -X: each op's position among its id's ops */
+    int *stage;                  /* -X: ops done so far on each id (shared) */
+    int cpu;                     /* cpu to pin this thread to (-1 = don't) */
+    int libc;                    /* replay with libc malloc instead of mm */
+    pthread_barrier_t *barrier;  /* all threads start replaying together */
+    double start;                /* monotonic time the replay started */
+    double end;                  /* monotonic time the replay finished */
+} thread_t;
+
+/* Per-process parameters and results for the multi-process replay (--procs) */
+typedef struct {
+    trace_t *trace;              /* the ops this process replays */
+    int *seq;                    /* -X: each op's position among its id's ops */
+    int *stage;                  /* -X: ops done so far on each id (shared) */
+    size_t *offs;                /* heap offset of each id's block (shared) */
+    int cpu;                     /* cpu to pin this process to (-1 = don't) */
+    pthread_barrier_t *barrier;  /* all processes start replaying together */
+    double *start;               /* monotonic time the replay started (shared) */
+    double *end;                 /* monotonic time the replay finished (shared) */
+} proc_t;
+
 /* Summarizes the important stats for some malloc function on some trace */
 typedef struct {
     /* defined for both libc malloc and student malloc package (mm.c) */
     double ops;      /* number of ops (malloc/free/realloc) in the trace */
     int valid;       /* was the trace processed correctly by the allocator? */
     double secs;     /* number of secs needed to run the trace */
+    double ci;       /* relative uncertainty of secs, fsecs_ci (0 = n/a) */
+    double weight;   /* weight of the trace in the aggregate scores */
 
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
 
+    /* defined only if hardware counters were requested (-P) */
+    perfctr_t pc;    /* event counts for one run of the trace */
+
+    /* defined only if per-op latencies were requested (--latency) */
+    double lat_p50;  /* median ns per op */
+    double lat_p99;  /* 99th percentile ns per op */
+    double lat_p999; /* 99.9th percentile ns per op */
+    double lat_max;  /* slowest op in ns */
+    double lat_heap; /* heap bytes at the end of the trace */
+
     /* Note: secs and util are only defined if valid is true */
 } stats_t; 
 
@@ -92,6 +209,51 @@ int verbose = 0;        /* global flag for verbose output */
 static int errors = 0;  /* number of errs found when running student malloc */
 char msg[MAXLINE];      /* for whenever we need to compose an error message */
 
+/* Cpu the timed phases are pinned to (-1 = not pinned) */
+static int timing_cpu = -1;
+
+/* If set, count hardware events for one extra run of each trace (-P) */
+static int use_perfctr = 0;
+
+/* If set, time every op of each trace separately (--latency) */
+static int use_latency = 0;
+
+/* MEM_PREFAULT and MEM_LOCK for every simulated heap (--prefault, --mlock) */
+static int heap_flags = 0;
+
+/* If set, print this many top call sites of each trace (--sites) */
+static int site_top = 0;
+
+/* If set, time each trace from a snapshot after this % of it (--steady) */
+static int steady_pct = 0;
+
+/* If set, reattach to each trace's heap in this heap file (--persist) */
+static char *persist_file = NULL;
+
+/* If set, sample the heap every frag_every ops into frag_dir (--frag) */
+static int frag_every = 0;
+static char frag_dir[MAXLINE] = ".";
+
+/* If set, dump heap maps into frag_dir at these ops (--map-at, --map-every) */
+static int map_every = 0;
+static int *map_ops = NULL;
+static int num_map_ops = 0;
+
+/* Weights and targets of the traces in the manifest (--manifest), or NULL */
+static target_t *targets = NULL;
+
+/* The allocators we can evaluate, and the one we do (-A) */
+static allocator_t allocators[] = {
+    {"mm", mm_init, mm_malloc, mm_free, mm_realloc, mm_heapstat, mm_heapmap,
+     mm_region_create, mm_region_alloc, mm_region_reset, mm_region_destroy,
+     mm_malloc_site, mm_site_sample, mm_site_dump, mm_sync, mm_features,
+     mm_touch},
+    {"buddy", buddy_init, buddy_malloc, buddy_free, buddy_realloc, 
+     buddy_heapstat, buddy_heapmap, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+     NULL, buddy_features, buddy_touch},
+};
+static allocator_t *mm = &allocators[0];
+
 /* Directory where default tracefiles are found */
 static char tracedir[MAXLINE] = TRACEDIR;
 
@@ -113,7 +275,14 @@ static void clear_ranges(range_t **ranges);
 
 /* These functions read, allocate, and free storage for traces */
 static trace_t *read_trace(char *tracedir, char *filename);
+static unsigned read_binary_ops(FILE *tracefile, trace_t *trace, char *path);
+static unsigned read_site(FILE *tracefile);
 static void free_trace(trace_t *trace);
+static void alloc_regions(trace_t *trace);
+static double trace_weight(trace_t *trace, int tracenum);
+
+/* This function replays the region requests of a trace */
+static int region_op(trace_t *trace, traceop_t *op, int libc);
 
 /* Routines for evaluating the correctness and speed of libc malloc */
 static int eval_libc_valid(trace_t *trace, int tracenum);
@@ -124,13 +293,75 @@ static void eval_libc_speed(void *ptr);
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
 static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
 static void eval_mm_speed(void *ptr);
+static void eval_site_speed(void *ptr);
+static void replay_ops(trace_t *trace, int lo, int hi);
+static void eval_mm_latency(trace_t *trace, stats_t *stats);
+static int cmp_double(const void *a, const void *b);
+static void eval_mm_frag(trace_t *trace, char *tracefile);
+static void frag_sample(FILE *fp, int opnum, long live);
+static FILE *open_frag_file(char *tracefile, char *suffix, char *mode);
+static int size_class(int size);
+static void eval_mm_map(trace_t *trace, char *tracefile);
+static void write_heapmap(FILE *fp, int opnum);
+static void parse_map_ops(char *list);
+static int cmp_int(const void *a, const void *b);
+
+/* These functions run all evaluations of one trace */
+static void eval_libc_trace(char *tracefile, int tracenum, stats_t *stats);
+static void eval_mm_trace(char *tracefile, int tracenum, stats_t *stats,
+			  range_t **ranges);
+static void eval_parallel(char **tracefiles, int num_tracefiles, 
+			  stats_t *stats, int libc, int njobs);
+static void eval_hugepages(char **tracefiles, int num_tracefiles,
+			   stats_t *stats, int flags);
+static void eval_coldstart(char **tracefiles, int num_tracefiles,
+			   stats_t *stats);
+static void eval_sites(char **tracefiles, int num_tracefiles, stats_t *stats);
+static void eval_steady(char **tracefiles, int num_tracefiles, stats_t *stats);
+static double time_suffix(trace_t *trace, int lo);
+static void eval_persist(char **tracefiles, int num_tracefiles, stats_t *stats);
+
+/* These functions replay traces concurrently on several threads */
+static trace_t *split_trace(trace_t *trace, int t, int nthreads, int **seq);
+static void *replay_thread(void *arg);
+static int run_threads(trace_t **parts, int **seqs, int nthreads, int libc,
+		       double *wall, double *thr_secs);
+static void eval_threads(char **tracefiles, int num_tracefiles, 
+			 int maxthreads, int per_thread, int cross, int libc);
+
+/* And on several processes that share one heap */
+static void *shared_calloc(size_t size);
+static void replay_proc(void *arg);
+static int run_procs(trace_t **parts, int **seqs, int nprocs, double *wall);
+static int kill_holder(int broken);
+static void eval_dead_holder(void);
+static void eval_procs(char **tracefiles, int num_tracefiles, 
+		       int maxprocs, int cross);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printcounters(int n, stats_t *stats);
+static void printlatency(int n, stats_t *stats);
+
+/* These functions save results and compare them with a saved run */
+static void writeresults(char *filename, int csv, char **tracefiles, int n,
+			 stats_t *mm_stats, stats_t *libc_stats, 
+			 double perfindex);
+static int read_baseline(char *filename, baseline_t **base);
+static int compare_baseline(char *filename, char **tracefiles, int n, 
+			    stats_t *stats);
+static char *trace_name(char *tracefile);
+static int read_manifest(char *filename, char ***tracefiles);
+static int check_targets(char **tracefiles, int n, stats_t *stats);
+static double json_number(char *line, char *key);
 static void usage(void);
 static void unix_error(char *msg);
 static void malloc_error(int tracenum, int opnum, char *msg);
 static void app_error(char *msg);
+static double mono_secs(void);
+static int allowed_cpus(int *cpus);
+static int timing_cpus(int *cpus);
+static void pin_cpu(int cpu);
 
 /**************
  * Main routine
@@ -138,27 +369,58 @@ static void app_error(char *msg);
 int main(int argc, char **argv)
 {
     int i;
-    char c;
+    int c;
     char **tracefiles = NULL;  /* null-terminated array of trace file names */
     int num_tracefiles = 0;    /* the number of traces in that array */
-    trace_t *trace = NULL;     /* stores a single trace file in memory */
     range_t *ranges = NULL;    /* keeps track of block extents for one trace */
     stats_t *libc_stats = NULL;/* libc stats for each trace */
     stats_t *mm_stats = NULL;  /* mm (i.e. student) stats for each trace */
-    speed_t speed_params;      /* input parameters to the xx_speed routines */ 
 
     int team_check = 1;  /* If set, check team structure (reset by -a) */
     int run_libc = 0;    /* If set, run libc malloc (set by -l) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
+    int maxthreads = 0;  /* If set, replay on up to this many threads (-T) */
+    int maxprocs = 0;    /* If set, replay on up to this many processes (--procs) */
+    int per_thread = 0;  /* If set, one whole trace per thread (-p) */
+    int cross = 0;       /* If set, free each block on another thread (-X) */
+    int njobs = -1;      /* If >= 0, evaluate traces in parallel (-j) */
+    int huge_flags = 0;  /* If set, compare with a huge page heap (-H) */
+    int cold = 0;        /* If set, compare first and later runs (--cold) */
+    char *json_file = NULL;     /* If set, save results as JSON (--json) */
+    char *csv_file = NULL;      /* If set, save results as CSV (--csv) */
+    char *baseline_file = NULL; /* If set, compare with this run (--baseline) */
+    int regressions = 0;        /* number of regressions against baseline */
+    int missed = 0;             /* number of missed manifest targets */
+    static struct option long_options[] = {
+	{"json", required_argument, NULL, OPT_JSON},
+	{"csv", required_argument, NULL, OPT_CSV},
+	{"baseline", required_argument, NULL, OPT_BASELINE},
+	{"frag", required_argument, NULL, OPT_FRAG},
+	{"frag-dir", required_argument, NULL, OPT_FRAG_DIR},
+	{"map-at", required_argument, NULL, OPT_MAP_AT},
+	{"map-every", required_argument, NULL, OPT_MAP_EVERY},
+	{"manifest", required_argument, NULL, OPT_MANIFEST},
+	{"latency", no_argument, NULL, OPT_LATENCY},
+	{"cold", no_argument, NULL, OPT_COLD},
+	{"prefault", no_argument, NULL, OPT_PREFAULT},
+	{"mlock", no_argument, NULL, OPT_MLOCK},
+	{"sites", required_argument, NULL, OPT_SITES},
+	{"steady", required_argument, NULL, OPT_STEADY},
+	{"persist", required_argument, NULL, OPT_PERSIST},
+	{"procs", required_argument, NULL, OPT_PROCS},
+	{NULL, 0, NULL, 0}
+    };
 
     /* temporaries used to compute the performance index */
     double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
+    double weights;
     int numcorrect;
     
     /* 
      * Read and interpret the command line arguments 
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF) {
+    while ((c = getopt_long(argc, argv, "f:t:hvVgalA:T:pXj:PH:", 
+			    long_options, NULL)) != EOF) {
         switch (c) {
 	case 'g': /* Generate summary info for the autograder */
 	    autograder = 1;
@@ -184,12 +446,122 @@ int main(int argc, char **argv)
         case 'l': /* Run libc malloc */
             run_libc = 1;
             break;
+        case 'A': /* Evaluate this allocator instead of mm.c */
+            for (i = 0; i < sizeof(allocators) / sizeof(allocator_t); i++)
+		if (!strcmp(optarg, allocators[i].name))
+		    break;
+	    if (i == sizeof(allocators) / sizeof(allocator_t)) {
+		usage();
+		exit(1);
+	    }
+	    mm = &allocators[i];
+            break;
+        case 'T': /* Replay the traces on 1, 2, 4, ... maxthreads threads */
+            if ((maxthreads = atoi(optarg)) < 1) {
+		usage();
+		exit(1);
+	    }
+            break;
+        case 'p': /* With -T, give each thread its own whole trace */
+            per_thread = 1;
+            break;
+        case 'X': /* With -T, free every block on the next thread */
+            cross = 1;
+            break;
+        case 'P': /* Count hardware events with perf_event_open */
+            use_perfctr = 1;
+            break;
+        case 'H': /* Compare throughput with the heap on huge pages */
+            if (!strcmp(optarg, "thp"))
+		huge_flags = MEM_THP;
+	    else if (!strcmp(optarg, "hugetlb"))
+		huge_flags = MEM_HUGETLB;
+	    else {
+		usage();
+		exit(1);
+	    }
+            break;
+        case 'j': /* Evaluate traces in parallel worker processes */
+            if ((njobs = atoi(optarg)) < 0) {
+		usage();
+		exit(1);
+	    }
+            break;
         case 'v': /* Print per-trace performance breakdown */
             verbose = 1;
             break;
         case 'V': /* Be more verbose than -v */
             verbose = 2;
             break;
+        case OPT_JSON: /* Save the results as JSON */
+            json_file = optarg;
+            break;
+        case OPT_CSV: /* Save the results as CSV */
+            csv_file = optarg;
+            break;
+        case OPT_BASELINE: /* Compare the results with a saved run */
+            baseline_file = optarg;
+            break;
+        case OPT_FRAG: /* Sample the heap's fragmentation every N ops */
+            if ((frag_every = atoi(optarg)) < 1) {
+		usage();
+		exit(1);
+	    }
+            break;
+        case OPT_FRAG_DIR: /* Directory for the --frag and --map output */
+            if (strlen(optarg) >= sizeof(frag_dir)) {
+		usage();
+		exit(1);
+	    }
+            strcpy(frag_dir, optarg);
+            break;
+        case OPT_MAP_AT: /* Dump heap maps after these ops */
+            parse_map_ops(optarg);
+            break;
+        case OPT_MAP_EVERY: /* Dump a heap map every N ops */
+            if ((map_every = atoi(optarg)) < 1) {
+		usage();
+		exit(1);
+	    }
+            break;
+        case OPT_MANIFEST: /* Weighted traces (relative to curr dir) */
+	    strcpy(tracedir, "./"); 
+            num_tracefiles = read_manifest(optarg, &tracefiles);
+            break;
+        case OPT_LATENCY: /* Time every op for the latency percentiles */
+            use_latency = 1;
+            break;
+        case OPT_COLD: /* Time the first run on a new heap separately */
+            cold = 1;
+            break;
+        case OPT_PREFAULT: /* Fault in the whole heap at mem_init */
+            heap_flags |= MEM_PREFAULT;
+            break;
+        case OPT_MLOCK: /* Fault in and lock the whole heap at mem_init */
+            heap_flags |= MEM_PREFAULT | MEM_LOCK;
+            break;
+        case OPT_SITES: /* Attribute allocator time and bytes to call sites */
+            if ((site_top = atoi(optarg)) < 1) {
+		usage();
+		exit(1);
+	    }
+            break;
+        case OPT_STEADY: /* Time the rest of each trace from a snapshot */
+            steady_pct = atoi(optarg);
+            if (steady_pct < 1 || steady_pct > 99) {
+		usage();
+		exit(1);
+	    }
+            break;
+        case OPT_PERSIST: /* Reattach to the heap in a heap file */
+            persist_file = strdup(optarg);
+            break;
+        case OPT_PROCS: /* Replay on 1, 2, 4, ... maxprocs processes */
+            if ((maxprocs = atoi(optarg)) < 1) {
+		usage();
+		exit(1);
+	    }
+            break;
         case 'h': /* Print this message */
 	    usage();
             exit(0);
@@ -225,6 +597,37 @@ int main(int argc, char **argv)
 	    printf("Member 2 :%s:%s\n", team.name2, team.id2);
     }
 
+    /*
+     * Check that the allocator was built for what we were asked to do
+     */
+    if ((maxthreads > 0 || maxprocs > 0) && !(mm->features() & MM_THREAD_SAFE)) {
+	sprintf(msg, "%s malloc was built without a lock and cannot be shared "
+		"by threads or processes (build mm.c with make THREAD_SAFE=1)",
+		mm->name);
+	app_error(msg);
+    }
+    if (persist_file != NULL && !(mm->features() & MM_PERSIST)) {
+	sprintf(msg, "%s malloc cannot reattach to a heap file, which --persist "
+		"needs (build mm.c with make PERSIST=1)", mm->name);
+	app_error(msg);
+    }
+    if (maxprocs > 0 && !(mm->features() & MM_PERSIST)) {
+	sprintf(msg, "%s malloc cannot reattach to a heap another process "
+		"made, which --procs needs (build mm.c with make PERSIST=1 "
+		"THREAD_SAFE=1)", mm->name);
+	app_error(msg);
+    }
+    if (maxthreads > 0 && cross && !(mm->features() & MM_REMOTE_FREE)) {
+	sprintf(msg, "%s malloc was built without remote frees, which -T -X "
+		"measures (build mm.c with make REMOTE_FREE=1)", mm->name);
+	app_error(msg);
+    }
+    if (site_top > 0 && !(mm->features() & MM_SITE_PROFILE)) {
+	sprintf(msg, "%s malloc was built without site profiling, which --sites "
+		"needs (build mm.c with make SITE_PROFILE=1)", mm->name);
+	app_error(msg);
+    }
+
     /* 
      * If no -f command line arg, then use the entire set of tracefiles 
      * defined in default_traces[]
@@ -238,6 +641,13 @@ int main(int argc, char **argv)
     /* Initialize the timing package */
     init_fsecs();
 
+    /* Open the hardware counters, or carry on without them */
+    if (use_perfctr && perfctr_init() == 0) {
+	printf("Hardware counters unavailable (%s), continuing without them.\n",
+	       perfctr_error());
+	use_perfctr = 0;
+    }
+
     /*
      * Optionally run and evaluate the libc malloc package 
      */
@@ -251,33 +661,28 @@ int main(int argc, char **argv)
 	    unix_error("libc_stats calloc in main failed");
 	
 	/* Evaluate the libc malloc package using the K-best scheme */
-	for (i=0; i < num_tracefiles; i++) {
-	    trace = read_trace(tracedir, tracefiles[i]);
-	    libc_stats[i].ops = trace->num_ops;
-	    if (verbose > 1)
-		printf("Checking libc malloc for correctness, ");
-	    libc_stats[i].valid = eval_libc_valid(trace, i);
-	    if (libc_stats[i].valid) {
-		speed_params.trace = trace;
-		if (verbose > 1)
-		    printf("and performance.\n");
-		libc_stats[i].secs = fsecs(eval_libc_speed, &speed_params);
-	    }
-	    free_trace(trace);
-	}
+	if (njobs >= 0)
+	    eval_parallel(tracefiles, num_tracefiles, libc_stats, 1, njobs);
+	else
+	    for (i=0; i < num_tracefiles; i++)
+		eval_libc_trace(tracefiles[i], i, &libc_stats[i]);
 
 	/* Display the libc results in a compact table */
 	if (verbose) {
 	    printf("\nResults for libc malloc:\n");
 	    printresults(num_tracefiles, libc_stats);
 	}
+	if (use_perfctr) {
+	    printf("\nHardware counters for libc malloc:\n");
+	    printcounters(num_tracefiles, libc_stats);
+	}
     }
 
     /*
      * Always run and evaluate the student's mm package
      */
     if (verbose > 1)
-	printf("\nTesting mm malloc\n");
+	printf("\nTesting %s malloc\n", mm->name);
 
     /* Allocate the mm stats array, with one stats_t struct per tracefile */
     mm_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
@@ -285,50 +690,100 @@ int main(int argc, char **argv)
 	unix_error("mm_stats calloc in main failed");
     
     /* Initialize the simulated memory system in memlib.c */
+    mem_set_flags(heap_flags);
     mem_init(); 
 
     /* Evaluate student's mm malloc package using the K-best scheme */
-    for (i=0; i < num_tracefiles; i++) {
-	trace = read_trace(tracedir, tracefiles[i]);
-	mm_stats[i].ops = trace->num_ops;
-	if (verbose > 1)
-	    printf("Checking mm_malloc for correctness, ");
-	mm_stats[i].valid = eval_mm_valid(trace, i, &ranges);
-	if (mm_stats[i].valid) {
-	    if (verbose > 1)
-		printf("efficiency, ");
-	    mm_stats[i].util = eval_mm_util(trace, i, &ranges);
-	    speed_params.trace = trace;
-	    speed_params.ranges = ranges;
-	    if (verbose > 1)
-		printf("and performance.\n");
-	    mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
-	}
-	free_trace(trace);
-    }
+    if (njobs >= 0)
+	eval_parallel(tracefiles, num_tracefiles, mm_stats, 0, njobs);
+    else
+	for (i=0; i < num_tracefiles; i++)
+	    eval_mm_trace(tracefiles[i], i, &mm_stats[i], &ranges);
 
     /* Display the mm results in a compact table */
     if (verbose) {
-	printf("\nResults for mm malloc:\n");
+	printf("\nResults for %s malloc:\n", mm->name);
 	printresults(num_tracefiles, mm_stats);
 	printf("\n");
     }
+    if (use_perfctr) {
+	printf("Hardware counters for %s malloc:\n", mm->name);
+	printcounters(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+    if (use_latency) {
+	printf("Latency per op for %s malloc (ns, fastest of %d runs):\n", 
+	       mm->name, LAT_RUNS);
+	printlatency(num_tracefiles, mm_stats);
+	printf("\n");
+    }
+
+    /*
+     * Optionally measure how the allocators scale with the thread count
+     */
+    if (maxthreads > 0) {
+	if (run_libc)
+	    eval_threads(tracefiles, num_tracefiles, maxthreads, 
+			 per_thread, cross, 1);
+	eval_threads(tracefiles, num_tracefiles, maxthreads, 
+		     per_thread, cross, 0);
+    }
+
+    /*
+     * Optionally measure how the allocator scales with processes that
+     * share its heap
+     */
+    if (maxprocs > 0)
+	eval_procs(tracefiles, num_tracefiles, maxprocs, cross);
+
+    /*
+     * Optionally measure the effect of putting the heap on huge pages
+     */
+    if (huge_flags)
+	eval_hugepages(tracefiles, num_tracefiles, mm_stats, huge_flags);
+
+    /*
+     * Optionally measure the first run on a new heap apart from the rest
+     */
+    if (cold)
+	eval_coldstart(tracefiles, num_tracefiles, mm_stats);
+
+    /*
+     * Optionally attribute the allocator's time and bytes to call sites
+     */
+    if (site_top > 0)
+	eval_sites(tracefiles, num_tracefiles, mm_stats);
+
+    /*
+     * Optionally time each trace from the middle, without the warm-up
+     */
+    if (steady_pct > 0)
+	eval_steady(tracefiles, num_tracefiles, mm_stats);
+
+    /*
+     * Optionally keep each trace's heap in a file and reattach to it
+     */
+    if (persist_file != NULL)
+	eval_persist(tracefiles, num_tracefiles, mm_stats);
 
     /* 
-     * Accumulate the aggregate statistics for the student's mm package 
+     * Accumulate the aggregate statistics for the student's mm package,
+     * each trace counting as many times as its weight
      */
     secs = 0;
     ops = 0;
     util = 0;
+    weights = 0;
     numcorrect = 0;
     for (i=0; i < num_tracefiles; i++) {
-	secs += mm_stats[i].secs;
-	ops += mm_stats[i].ops;
-	util += mm_stats[i].util;
+	secs += mm_stats[i].weight * mm_stats[i].secs;
+	ops += mm_stats[i].weight * mm_stats[i].ops;
+	util += mm_stats[i].weight * mm_stats[i].util;
+	weights += mm_stats[i].weight;
 	if (mm_stats[i].valid)
 	    numcorrect++;
     }
-    avg_mm_util = util/num_tracefiles;
+    avg_mm_util = util/weights;
 
     /* 
      * Compute and print the performance index 
@@ -357,12 +812,27 @@ int main(int argc, char **argv)
 	printf("Terminated with %d errors\n", errors);
     }
 
+    /* 
+     * Optionally save the results and compare them with a saved run
+     */
+    if (json_file)
+	writeresults(json_file, 0, tracefiles, num_tracefiles, 
+		     mm_stats, libc_stats, perfindex);
+    if (csv_file)
+	writeresults(csv_file, 1, tracefiles, num_tracefiles, 
+		     mm_stats, libc_stats, perfindex);
+    if (baseline_file)
+	regressions = compare_baseline(baseline_file, tracefiles, 
+				       num_tracefiles, mm_stats);
+    if (targets)
+	missed = check_targets(tracefiles, num_tracefiles, mm_stats);
+
     if (autograder) {
 	printf("correct:%d\n", numcorrect);
 	printf("perfidx:%.0f\n", perfindex);
     }
 
-    exit(0);
+    exit((regressions || missed) ? 2 : 0);
 }
 
 
@@ -469,17 +939,21 @@ static void clear_ranges(range_t **ranges)
  *********************************************/
 
 /*
- * read_trace - read a trace file and store it in memory
+ * read_trace - read a trace file and store it in memory. The file can be
+ *     in the text format of traces/README or in the binary format of
+ *     tracefmt.h.
  */
 static trace_t *read_trace(char *tracedir, char *filename)
 {
     FILE *tracefile;
     trace_t *trace;
+    tracefmt_hdr_t hdr;
     char type[MAXLINE];
     char path[MAXLINE];
-    unsigned index, size;
+    unsigned index, size, region;
     unsigned max_index = 0;
     unsigned op_index;
+    int binary;
 
     if (verbose > 1)
 	printf("Reading tracefile: %s\n", filename);
@@ -491,14 +965,25 @@ static trace_t *read_trace(char *tracedir, char *filename)
     /* Read the trace file header */
     strcpy(path, tracedir);
     strcat(path, filename);
-    if ((tracefile = fopen(path, "r")) == NULL) {
+    if ((tracefile = fopen(path, "rb")) == NULL) {
 	sprintf(msg, "Could not open %s in read_trace", path);
 	unix_error(msg);
     }
-    fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
-    fscanf(tracefile, "%d", &(trace->num_ids));     
-    fscanf(tracefile, "%d", &(trace->num_ops));     
-    fscanf(tracefile, "%d", &(trace->weight));        /* not used */
+    binary = (fread(&hdr, sizeof(hdr), 1, tracefile) == 1 &&
+	      memcmp(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic)) == 0);
+    if (binary) {
+	trace->sugg_heapsize = hdr.sugg_heapsize; /* not used */
+	trace->num_ids = hdr.num_ids;
+	trace->num_ops = hdr.num_ops;
+	trace->weight = hdr.weight;
+    }
+    else {
+	rewind(tracefile);
+	fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
+	fscanf(tracefile, "%d", &(trace->num_ids));     
+	fscanf(tracefile, "%d", &(trace->num_ops));     
+	fscanf(tracefile, "%d", &(trace->weight));
+    }
     
     /* We'll store each request line in the trace in this array */
     if ((trace->ops = 
@@ -515,16 +1000,26 @@ static trace_t *read_trace(char *tracedir, char *filename)
 	 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
 	unix_error("malloc 4 failed in read_trace");
     
+    if (binary) {
+	max_index = read_binary_ops(tracefile, trace, path);
+	fclose(tracefile);
+	assert(max_index == trace->num_ids - 1);
+	alloc_regions(trace);
+	return trace;
+    }
+
     /* read every request line in the trace file */
     index = 0;
     op_index = 0;
     while (fscanf(tracefile, "%s", type) != EOF) {
+	trace->ops[op_index].site = 0;
 	switch(type[0]) {
 	case 'a':
 	    fscanf(tracefile, "%u %u", &index, &size);
 	    trace->ops[op_index].type = ALLOC;
 	    trace->ops[op_index].index = index;
 	    trace->ops[op_index].size = size;
+	    trace->ops[op_index].site = read_site(tracefile);
 	    max_index = (index > max_index) ? index : max_index;
 	    break;
 	case 'r':
@@ -539,6 +1034,24 @@ static trace_t *read_trace(char *tracedir, char *filename)
 	    trace->ops[op_index].type = FREE;
 	    trace->ops[op_index].index = index;
 	    break;
+	case 'b':
+	    fscanf(tracefile, "%u %u %u", &region, &index, &size);
+	    trace->ops[op_index].type = REGION_ALLOC;
+	    trace->ops[op_index].index = index;
+	    trace->ops[op_index].size = size;
+	    trace->ops[op_index].region = region;
+	    max_index = (index > max_index) ? index : max_index;
+	    break;
+	case 'n':
+	case 'x':
+	case 'd':
+	    fscanf(tracefile, "%u", &region);
+	    trace->ops[op_index].type = (type[0] == 'n') ? REGION_NEW :
+		(type[0] == 'x') ? REGION_RESET : REGION_FREE;
+	    trace->ops[op_index].index = region;
+	    trace->ops[op_index].region = region;
+	    max_index = (region > max_index) ? region : max_index;
+	    break;
 	default:
 	    printf("Bogus type character (%c) in tracefile %s\n", 
 		   type[0], path);
@@ -550,22 +1063,190 @@ static trace_t *read_trace(char *tracedir, char *filename)
     fclose(tracefile);
     assert(max_index == trace->num_ids - 1);
     assert(trace->num_ops == op_index);
+    alloc_regions(trace);
     
     return trace;
 }
 
 /*
- * free_trace - Free the trace record and the three arrays it points
+ * read_binary_ops - Read the num_ops records of a binary trace into
+ *     trace->ops, a buffer at a time, and return the largest id
+ */
+static unsigned read_binary_ops(FILE *tracefile, trace_t *trace, char *path)
+{
+    tracefmt_rec_t rec[4096];
+    unsigned max_index = 0;
+    int i, n, op_index = 0;
+
+    while (op_index < trace->num_ops) {
+	n = trace->num_ops - op_index;
+	if (n > 4096)
+	    n = 4096;
+	if (fread(rec, sizeof(tracefmt_rec_t), n, tracefile) != n) {
+	    sprintf(msg, "Tracefile %s is truncated", path);
+	    app_error(msg);
+	}
+	for (i = 0; i < n; i++, op_index++) {
+	    switch (rec[i].type) {
+	    case 'a':
+		trace->ops[op_index].type = ALLOC;
+		break;
+	    case 'r':
+		trace->ops[op_index].type = REALLOC;
+		break;
+	    case 'f':
+		trace->ops[op_index].type = FREE;
+		break;
+	    case 'b':
+		trace->ops[op_index].type = REGION_ALLOC;
+		break;
+	    case 'n':
+		trace->ops[op_index].type = REGION_NEW;
+		break;
+	    case 'x':
+		trace->ops[op_index].type = REGION_RESET;
+		break;
+	    case 'd':
+		trace->ops[op_index].type = REGION_FREE;
+		break;
+	    default:
+		printf("Bogus record type (%u) in tracefile %s\n", 
+		       rec[i].type, path);
+		exit(1);
+	    }
+	    trace->ops[op_index].index = rec[i].id;
+	    trace->ops[op_index].size = rec[i].size;
+	    trace->ops[op_index].region = (rec[i].type == 'b') ? 
+		rec[i].extra : rec[i].id;
+	    trace->ops[op_index].site = (rec[i].type == 'a') ? 
+		rec[i].extra : 0;
+	    max_index = (rec[i].id > max_index) ? rec[i].id : max_index;
+	}
+    }
+    return max_index;
+}
+
+/*
+ * read_site - Read the optional call site at the end of an alloc
+ *     line, or return 0 if the line has none
+ */
+static unsigned read_site(FILE *tracefile)
+{
+    unsigned site = 0;
+    int c;
+
+    while ((c = getc(tracefile)) == ' ' || c == '\t')
+	;
+    if (c != EOF)
+	ungetc(c, tracefile);
+    if (isdigit(c))
+	fscanf(tracefile, "%u", &site);
+    return site;
+}
+
+/*
+ * free_trace - Free the trace record and the arrays it points
  *              to, all of which were allocated in read_trace().
  */
 void free_trace(trace_t *trace)
 {
-    free(trace->ops);         /* free the three arrays... */
+    free(trace->ops);         /* free the arrays... */
     free(trace->blocks);      
     free(trace->block_sizes);
+    free(trace->regions);
+    free(trace->reg_head);
+    free(trace->reg_next);
     free(trace);              /* and the trace record itself... */
 }
 
+/*
+ * alloc_regions - Allocate the region arrays of a trace if it has
+ *     region requests, and set them to NULL if it doesn't
+ */
+static void alloc_regions(trace_t *trace)
+{
+    int i;
+
+    trace->regions = NULL;
+    trace->reg_head = trace->reg_next = NULL;
+    for (i = 0; i < trace->num_ops; i++)
+	if (trace->ops[i].type >= REGION_NEW)
+	    break;
+    if (i == trace->num_ops)
+	return;
+    if ((trace->regions = (mm_region_t **)
+	 calloc(trace->num_ids, sizeof(mm_region_t *))) == NULL ||
+	(trace->reg_head = (int *)malloc(trace->num_ids * sizeof(int))) == NULL ||
+	(trace->reg_next = (int *)malloc(trace->num_ids * sizeof(int))) == NULL)
+	unix_error("malloc failed in alloc_regions");
+}
+
+/*
+ * trace_weight - The weight of a trace in the aggregate scores: its
+ *     weight in the manifest if there is one, else the weight in its
+ *     header
+ */
+static double trace_weight(trace_t *trace, int tracenum)
+{
+    if (targets)
+	return targets[tracenum].weight;
+    return (trace->weight > 0) ? trace->weight : 1;
+}
+
+/*
+ * region_op - Replay one region request (n, b, x or d) of a trace.
+ *     Returns 0 if the allocator could not create the region or the
+ *     block. The ids allocated in each region are chained through
+ *     reg_next, newest first, so that callers can visit them before a
+ *     reset or destroy. For libc malloc and allocators without regions,
+ *     each block is malloc'd and the reset frees them one by one, which
+ *     is what a program without regions would do.
+ */
+static int region_op(trace_t *trace, traceop_t *op, int libc)
+{
+    int r = op->region;
+    int id, native = !libc && mm->region_create != NULL;
+    char *p;
+
+    switch (op->type) {
+    case REGION_NEW:
+	if (native && (trace->regions[r] = mm->region_create()) == NULL)
+	    return 0;
+	trace->reg_head[r] = -1;
+	break;
+
+    case REGION_ALLOC:
+	p = native ? mm->region_alloc(trace->regions[r], op->size) :
+	    libc ? malloc(op->size) : mm->malloc(op->size);
+	if (p == NULL)
+	    return 0;
+	trace->blocks[op->index] = p;
+	trace->reg_next[op->index] = trace->reg_head[r];
+	trace->reg_head[r] = op->index;
+	break;
+
+    case REGION_RESET:
+    case REGION_FREE:
+	if (!native) {
+	    for (id = trace->reg_head[r]; id >= 0; id = trace->reg_next[id])
+		if (libc)
+		    free(trace->blocks[id]);
+		else
+		    mm->free(trace->blocks[id]);
+	}
+	else if (op->type == REGION_RESET)
+	    mm->region_reset(trace->regions[r]);
+	else
+	    mm->region_destroy(trace->regions[r]);
+	trace->reg_head[r] = -1;
+	break;
+
+    default:
+	app_error("Nonexistent region request type in region_op");
+    }
+    return 1;
+}
+
 /**********************************************************************
  * The following functions evaluate the correctness, space utilization,
  * and throughput of the libc and mm malloc packages.
@@ -576,7 +1257,7 @@ void free_trace(trace_t *trace)
  */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) 
 {
-    int i, j;
+    int i, j, k, r;
     int index;
     int size;
     int oldsize;
@@ -589,7 +1270,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
     clear_ranges(ranges);
 
     /* Call the mm package's init function */
-    if (mm_init() < 0) {
+    if (mm->init() < 0) {
 	malloc_error(tracenum, 0, "mm_init failed.");
 	return 0;
     }
@@ -604,7 +1285,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
         case ALLOC: /* mm_malloc */
 
 	    /* Call the student's malloc */
-	    if ((p = mm_malloc(size)) == NULL) {
+	    if ((p = mm->malloc(size)) == NULL) {
 		malloc_error(tracenum, i, "mm_malloc failed.");
 		return 0;
 	    }
@@ -633,7 +1314,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    
 	    /* Call the student's realloc */
 	    oldp = trace->blocks[index];
-	    if ((newp = mm_realloc(oldp, size)) == NULL) {
+	    if ((newp = mm->realloc(oldp, size)) == NULL) {
 		malloc_error(tracenum, i, "mm_realloc failed.");
 		return 0;
 	    }
@@ -653,7 +1334,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    oldsize = trace->block_sizes[index];
 	    if (size < oldsize) oldsize = size;
 	    for (j = 0; j < oldsize; j++) {
-	      if (newp[j] != (index & 0xFF)) {
+	      if ((unsigned char)newp[j] != (index & 0xFF)) {
 		malloc_error(tracenum, i, "mm_realloc did not preserve the "
 			     "data from old block");
 		return 0;
@@ -671,7 +1352,44 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	    /* Remove region from list and call student's free function */
 	    p = trace->blocks[index];
 	    remove_range(ranges, p);
-	    mm_free(p);
+	    mm->free(p);
+	    break;
+
+	case REGION_ALLOC: /* mm_region_alloc */
+	    if (!region_op(trace, &trace->ops[i], 0)) {
+		malloc_error(tracenum, i, "mm_region_alloc failed.");
+		return 0;
+	    }
+	    p = trace->blocks[index];
+	    if (add_range(ranges, p, size, tracenum, i) == 0)
+		return 0;
+	    memset(p, index & 0xFF, size);
+	    trace->block_sizes[index] = size;
+	    break;
+
+	case REGION_RESET: /* mm_region_reset */
+	case REGION_FREE:  /* mm_region_destroy */
+
+	    /* The blocks of the region must have kept their data */
+	    r = trace->ops[i].region;
+	    for (j = trace->reg_head[r]; j >= 0; j = trace->reg_next[j]) {
+		p = trace->blocks[j];
+		for (k = 0; k < trace->block_sizes[j]; k++)
+		    if (p[k] != (char)(j & 0xFF)) {
+			malloc_error(tracenum, i, "a region block was "
+				     "overwritten before the reset");
+			return 0;
+		    }
+		remove_range(ranges, p);
+	    }
+	    region_op(trace, &trace->ops[i], 0);
+	    break;
+
+	case REGION_NEW: /* mm_region_create */
+	    if (!region_op(trace, &trace->ops[i], 0)) {
+		malloc_error(tracenum, i, "mm_region_create failed.");
+		return 0;
+	    }
 	    break;
 
 	default:
@@ -697,7 +1415,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
  */
 static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 {   
-    int i;
+    int i, j, r;
     int index;
     int size, newsize, oldsize;
     int max_total_size = 0;
@@ -707,7 +1425,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 
     /* initialize the heap and the mm malloc package */
     mem_reset_brk();
-    if (mm_init() < 0)
+    if (mm->init() < 0)
 	app_error("mm_init failed in eval_mm_util");
 
     for (i = 0;  i < trace->num_ops;  i++) {
@@ -717,7 +1435,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    index = trace->ops[i].index;
 	    size = trace->ops[i].size;
 
-	    if ((p = mm_malloc(size)) == NULL) 
+	    if ((p = mm->malloc(size)) == NULL) 
 		app_error("mm_malloc failed in eval_mm_util");
 	    
 	    /* Remember region and size */
@@ -739,7 +1457,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    oldsize = trace->block_sizes[index];
 
 	    oldp = trace->blocks[index];
-	    if ((newp = mm_realloc(oldp,newsize)) == NULL)
+	    if ((newp = mm->realloc(oldp,newsize)) == NULL)
 		app_error("mm_realloc failed in eval_mm_util");
 
 	    /* Remember region and size */
@@ -760,7 +1478,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    size = trace->block_sizes[index];
 	    p = trace->blocks[index];
 	    
-	    mm_free(p);
+	    mm->free(p);
 	    
 	    /* Keep track of current total size
 	     * of all allocated blocks */
@@ -768,6 +1486,30 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    
 	    break;
 
+	case REGION_ALLOC: /* mm_region_alloc */
+	    index = trace->ops[i].index;
+	    size = trace->ops[i].size;
+	    if (!region_op(trace, &trace->ops[i], 0))
+		app_error("mm_region_alloc failed in eval_mm_util");
+	    trace->block_sizes[index] = size;
+	    total_size += size;
+	    max_total_size = (total_size > max_total_size) ?
+		total_size : max_total_size;
+	    break;
+
+	case REGION_RESET: /* mm_region_reset */
+	case REGION_FREE:  /* mm_region_destroy */
+	    r = trace->ops[i].region;
+	    for (j = trace->reg_head[r]; j >= 0; j = trace->reg_next[j])
+		total_size -= trace->block_sizes[j];
+	    region_op(trace, &trace->ops[i], 0);
+	    break;
+
+	case REGION_NEW: /* mm_region_create */
+	    if (!region_op(trace, &trace->ops[i], 0))
+		app_error("mm_region_create failed in eval_mm_util");
+	    break;
+
 	default:
 	    app_error("Nonexistent request type in eval_mm_util");
 
@@ -779,54 +1521,479 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 
 
 /*
- * eval_mm_speed - This is the function that is used by fcyc()
- *    to measure the running time of the mm malloc package.
+ * eval_mm_frag - Replay the trace to see when and why the heap grows.
+ *   Every frag_every ops, record the heap size, live payload, bytes in
+ *   allocated and free blocks, the number of free blocks, the largest
+ *   free block, and the internal and external fragmentation in 
+ *   <frag_dir>/<trace>.frag.csv. Internal fragmentation is the share
+ *   of allocated block bytes that isn't payload; external is the share
+ *   of free bytes outside the largest free block. Also keep a census
+ *   of the live objects by size class, and write the census taken at
+ *   the peak of live payload to <frag_dir>/<trace>.census.csv.
  */
-static void eval_mm_speed(void *ptr)
+static void eval_mm_frag(trace_t *trace, char *tracefile)
 {
-    int i, index, size, newsize;
-    char *p, *newp, *oldp, *block;
-    trace_t *trace = ((speed_t *)ptr)->trace;
+    FILE *series, *census;
+    long live_count[NCLASSES], live_bytes[NCLASSES];
+    long peak_count[NCLASSES], peak_bytes[NCLASSES];
+    long total_size = 0, max_total_size = 0;
+    size_t heapsize = 0;
+    int peak_op = 0, hwm_op = 0;
+    int i, j, k, r, index, size, oldsize;
+    char *p;
 
-    /* Reset the heap and initialize the mm package */
+    series = open_frag_file(tracefile, ".frag.csv", "w");
+    fprintf(series, "op,heap,live,alloc_bytes,free_bytes,free_blocks,"
+	    "largest_free,internal_frag,external_frag\n");
+    memset(live_count, 0, sizeof(live_count));
+    memset(live_bytes, 0, sizeof(live_bytes));
+    memset(peak_count, 0, sizeof(peak_count));
+    memset(peak_bytes, 0, sizeof(peak_bytes));
+
+    /* initialize the heap and the mm malloc package */
     mem_reset_brk();
-    if (mm_init() < 0) 
-	app_error("mm_init failed in eval_mm_speed");
+    if (mm->init() < 0)
+	app_error("mm_init failed in eval_mm_frag");
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+	index = trace->ops[i].index;
+	size = trace->ops[i].size;
 
-    /* Interpret each trace request */
-    for (i = 0;  i < trace->num_ops;  i++)
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_malloc */
-            index = trace->ops[i].index;
-            size = trace->ops[i].size;
-            if ((p = mm_malloc(size)) == NULL)
-		app_error("mm_malloc error in eval_mm_speed");
-            trace->blocks[index] = p;
-            break;
+	    if ((p = mm->malloc(size)) == NULL) 
+		app_error("mm_malloc failed in eval_mm_frag");
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    total_size += size;
+	    break;
 
 	case REALLOC: /* mm_realloc */
-	    index = trace->ops[i].index;
-            newsize = trace->ops[i].size;
-	    oldp = trace->blocks[index];
-            if ((newp = mm_realloc(oldp,newsize)) == NULL)
-		app_error("mm_realloc error in eval_mm_speed");
-            trace->blocks[index] = newp;
-            break;
+	    oldsize = trace->block_sizes[index];
+	    if ((p = mm->realloc(trace->blocks[index], size)) == NULL)
+		app_error("mm_realloc failed in eval_mm_frag");
+	    k = size_class(oldsize);
+	    live_count[k]--;
+	    live_bytes[k] -= oldsize;
+	    trace->blocks[index] = p;
+	    trace->block_sizes[index] = size;
+	    total_size += (size - oldsize);
+	    break;
 
         case FREE: /* mm_free */
-            index = trace->ops[i].index;
-            block = trace->blocks[index];
-            mm_free(block);
-            break;
+	    size = trace->block_sizes[index];
+	    mm->free(trace->blocks[index]);
+	    total_size -= size;
+	    break;
+
+	case REGION_ALLOC: /* mm_region_alloc */
+	    if (!region_op(trace, &trace->ops[i], 0))
+		app_error("mm_region_alloc failed in eval_mm_frag");
+	    trace->block_sizes[index] = size;
+	    total_size += size;
+	    break;
+
+	case REGION_RESET: /* mm_region_reset */
+	case REGION_FREE:  /* mm_region_destroy */
+	    r = trace->ops[i].region;
+	    for (j = trace->reg_head[r]; j >= 0; j = trace->reg_next[j]) {
+		k = size_class(trace->block_sizes[j]);
+		live_count[k]--;
+		live_bytes[k] -= trace->block_sizes[j];
+		total_size -= trace->block_sizes[j];
+	    }
+	    region_op(trace, &trace->ops[i], 0);
+	    break;
+
+	case REGION_NEW: /* mm_region_create */
+	    if (!region_op(trace, &trace->ops[i], 0))
+		app_error("mm_region_create failed in eval_mm_frag");
+	    break;
 
 	default:
-	    app_error("Nonexistent request type in eval_mm_valid");
+	    app_error("Nonexistent request type in eval_mm_frag");
         }
-}
 
-/*
- * eval_libc_valid - We run this function to make sure that the
+	/* Keep the census of live objects up to date */
+	k = size_class(size);
+	if (trace->ops[i].type == FREE) {
+	    live_count[k]--;
+	    live_bytes[k] -= size;
+	}
+	else if (trace->ops[i].type == ALLOC || trace->ops[i].type == REALLOC ||
+		 trace->ops[i].type == REGION_ALLOC) {
+	    live_count[k]++;
+	    live_bytes[k] += size;
+	}
+
+	/* Remember when live payload peaked and when the heap last grew */
+	if (total_size > max_total_size) {
+	    max_total_size = total_size;
+	    peak_op = i;
+	    memcpy(peak_count, live_count, sizeof(live_count));
+	    memcpy(peak_bytes, live_bytes, sizeof(live_bytes));
+	}
+	if (mem_heapsize() > heapsize) {
+	    heapsize = mem_heapsize();
+	    hwm_op = i;
+	}
+
+	if (i % frag_every == 0 || i == trace->num_ops - 1)
+	    frag_sample(series, i, total_size);
+    }
+    fclose(series);
+
+    /* Write the census at the peak */
+    census = open_frag_file(tracefile, ".census.csv", "w");
+    fprintf(census, "class_max,count,bytes\n");
+    for (k = 0; k < NCLASSES; k++)
+	if (peak_count[k] > 0)
+	    fprintf(census, "%lu,%ld,%ld\n", 1UL << k, peak_count[k], peak_bytes[k]);
+    fclose(census);
+
+    if (verbose)
+	printf("\n%s: live payload peaks at %ld bytes (op %d), "
+	       "heap reaches %lu bytes at op %d\n", trace_name(tracefile),
+	       max_total_size, peak_op, (unsigned long)heapsize, hwm_op);
+}
+
+/*
+ * frag_sample - Write one line of the fragmentation series
+ */
+static void frag_sample(FILE *fp, int opnum, long live)
+{
+    mm_heapstat_t st;
+
+    mm->heapstat(&st);
+    fprintf(fp, "%d,%lu,%ld,%lu,%lu,%lu,%lu,%.6f,%.6f\n", opnum, 
+	    (unsigned long)st.heap_bytes, live, 
+	    (unsigned long)st.alloc_bytes, (unsigned long)st.free_bytes, 
+	    (unsigned long)st.free_blocks, (unsigned long)st.largest_free,
+	    st.alloc_bytes ? 1.0 - (double)live / st.alloc_bytes : 0.0,
+	    st.free_bytes ? 1.0 - (double)st.largest_free / st.free_bytes : 0.0);
+}
+
+/*
+ * size_class - Return the census class of a request size: the k for
+ *     which 2^(k-1) < size <= 2^k
+ */
+static int size_class(int size)
+{
+    int k = 0;
+
+    while (k < NCLASSES-1 && (1L << k) < size)
+	k++;
+    return k;
+}
+
+/*
+ * open_frag_file - Open <frag_dir>/<trace><suffix> for the output of
+ *   --frag or --map-at/--map-every, or quit with a message if the path is too long
+ *   or the file can't be opened
+ */
+static FILE *open_frag_file(char *tracefile, char *suffix, char *mode)
+{
+    char path[MAXLINE];
+    FILE *fp;
+
+    if (snprintf(path, sizeof(path), "%s/%s%s", frag_dir, 
+		 trace_name(tracefile), suffix) >= sizeof(path)) {
+	printf("Output path for %s in %s is too long\n", 
+	       trace_name(tracefile), frag_dir);
+	exit(1);
+    }
+    if ((fp = fopen(path, mode)) == NULL) {
+	printf("Could not open %s: %s\n", path, strerror(errno));
+	exit(1);
+    }
+    return fp;
+}
+
+/*
+ * eval_mm_map - Replay the trace and dump a map of the heap, as
+ *   recorded by mm_heapmap, after each op listed with --map-at and
+ *   every map_every ops, into <frag_dir>/<trace>.map. Render the
+ *   dump with mapview.
+ */
+static void eval_mm_map(trace_t *trace, char *tracefile)
+{
+    FILE *fp;
+    int i, index, size, next = 0;
+    char *p;
+
+    fp = open_frag_file(tracefile, ".map", "wb");
+
+    /* initialize the heap and the mm malloc package */
+    mem_reset_brk();
+    if (mm->init() < 0)
+	app_error("mm_init failed in eval_mm_map");
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+	index = trace->ops[i].index;
+	size = trace->ops[i].size;
+
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* mm_malloc */
+	    if ((p = mm->malloc(size)) == NULL) 
+		app_error("mm_malloc failed in eval_mm_map");
+	    trace->blocks[index] = p;
+	    break;
+
+	case REALLOC: /* mm_realloc */
+	    if ((p = mm->realloc(trace->blocks[index], size)) == NULL)
+		app_error("mm_realloc failed in eval_mm_map");
+	    trace->blocks[index] = p;
+	    break;
+
+        case FREE: /* mm_free */
+	    mm->free(trace->blocks[index]);
+	    break;
+
+	default: /* region requests */
+	    if (!region_op(trace, &trace->ops[i], 0))
+		app_error("region request failed in eval_mm_map");
+        }
+
+	/* map_ops is sorted, so we only ever look at its next entry */
+	while (next < num_map_ops && map_ops[next] < i)
+	    next++;
+	if ((next < num_map_ops && map_ops[next] == i) ||
+	    (map_every > 0 && i % map_every == 0))
+	    write_heapmap(fp, i);
+    }
+    fclose(fp);
+}
+
+/*
+ * write_heapmap - Append one snapshot of the heap to a map file. The
+ *     record buffer is kept between calls and only grows, so taking a
+ *     snapshot costs one walk of the heap and one of the free list.
+ */
+static void write_heapmap(FILE *fp, int opnum)
+{
+    static mm_mapent_t *map = NULL;
+    static int max = 0;
+    heapmap_hdr_t hdr;
+    int n;
+
+    while ((n = mm->heapmap(map, max)) > max) {
+	max = 2 * n;
+	if ((map = realloc(map, max * sizeof(mm_mapent_t))) == NULL)
+	    unix_error("realloc failed in write_heapmap");
+    }
+
+    hdr.magic = HEAPMAP_MAGIC;
+    hdr.op = opnum;
+    hdr.heap_bytes = mem_heapsize();
+    hdr.nblocks = n;
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+	(n > 0 && fwrite(map, sizeof(mm_mapent_t), n, fp) != n))
+	unix_error("fwrite failed in write_heapmap");
+}
+
+/*
+ * parse_map_ops - Parse the comma separated op numbers of --map-at
+ */
+static void parse_map_ops(char *list)
+{
+    char *tok;
+
+    for (tok = strtok(list, ","); tok != NULL; tok = strtok(NULL, ",")) {
+	if ((map_ops = realloc(map_ops, (num_map_ops+1) * sizeof(int))) == NULL)
+	    unix_error("realloc failed in parse_map_ops");
+	map_ops[num_map_ops++] = atoi(tok);
+    }
+    qsort(map_ops, num_map_ops, sizeof(int), cmp_int);
+}
+
+static int cmp_int(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+/*
+ * eval_mm_speed - This is the function that is used by fcyc()
+ *    to measure the running time of the mm malloc package.
+ */
+static void eval_mm_speed(void *ptr)
+{
+    trace_t *trace = ((speed_t *)ptr)->trace;
+
+    /* Reset the heap and initialize the mm package */
+    mem_reset_brk();
+    if (mm->init() < 0) 
+	app_error("mm_init failed in eval_mm_speed");
+
+    replay_ops(trace, 0, trace->num_ops);
+}
+
+/*
+ * replay_ops - Interpret the requests lo..hi-1 of the trace, on the
+ *     heap as the requests before lo left it
+ */
+static void replay_ops(trace_t *trace, int lo, int hi)
+{
+    int i, index, size, newsize;
+    char *p, *newp, *oldp, *block;
+
+    for (i = lo;  i < hi;  i++)
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* mm_malloc */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            if ((p = mm->malloc(size)) == NULL)
+		app_error("mm_malloc error in replay_ops");
+            trace->blocks[index] = p;
+            break;
+
+	case REALLOC: /* mm_realloc */
+	    index = trace->ops[i].index;
+            newsize = trace->ops[i].size;
+	    oldp = trace->blocks[index];
+            if ((newp = mm->realloc(oldp,newsize)) == NULL)
+		app_error("mm_realloc error in replay_ops");
+            trace->blocks[index] = newp;
+            break;
+
+        case FREE: /* mm_free */
+            index = trace->ops[i].index;
+            block = trace->blocks[index];
+            mm->free(block);
+            break;
+
+	default: /* region requests */
+	    if (!region_op(trace, &trace->ops[i], 0))
+		app_error("region request failed in replay_ops");
+        }
+}
+
+/*
+ * eval_site_speed - eval_mm_speed with every malloc charged to its
+ *    call site through mm_malloc_site, for --sites
+ */
+static void eval_site_speed(void *ptr)
+{
+    int i, index, size, newsize;
+    char *p, *newp, *oldp, *block;
+    trace_t *trace = ((speed_t *)ptr)->trace;
+
+    /* Reset the heap and initialize the mm package */
+    mem_reset_brk();
+    if (mm->init() < 0) 
+	app_error("mm_init failed in eval_site_speed");
+
+    /* Interpret each trace request */
+    for (i = 0;  i < trace->num_ops;  i++)
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* mm_malloc_site */
+            index = trace->ops[i].index;
+            size = trace->ops[i].size;
+            if ((p = mm->malloc_site(size, trace->ops[i].site)) == NULL)
+		app_error("mm_malloc_site error in eval_site_speed");
+            trace->blocks[index] = p;
+            break;
+
+	case REALLOC: /* mm_realloc */
+	    index = trace->ops[i].index;
+            newsize = trace->ops[i].size;
+	    oldp = trace->blocks[index];
+            if ((newp = mm->realloc(oldp,newsize)) == NULL)
+		app_error("mm_realloc error in eval_site_speed");
+            trace->blocks[index] = newp;
+            break;
+
+        case FREE: /* mm_free */
+            index = trace->ops[i].index;
+            block = trace->blocks[index];
+            mm->free(block);
+            break;
+
+	default: /* region requests */
+	    if (!region_op(trace, &trace->ops[i], 0))
+		app_error("region request failed in eval_site_speed");
+        }
+}
+
+/*
+ * eval_mm_latency - Time every op of the trace on its own to get the
+ *     tail of the latency distribution, which the whole-trace timings
+ *     hide. The trace is replayed LAT_RUNS times and each op keeps its
+ *     fastest time, so that interrupts and page faults in one run don't
+ *     pass for allocator work. The times include one clock_gettime.
+ */
+static void eval_mm_latency(trace_t *trace, stats_t *stats)
+{
+    struct timespec t0, t1;
+    double *ns, t;
+    int i, n, run, index;
+    char *p;
+
+    if ((n = trace->num_ops) == 0)
+	return;
+    if ((ns = (double *)malloc(n * sizeof(double))) == NULL)
+	unix_error("malloc failed in eval_mm_latency");
+
+    pin_cpu(timing_cpu);
+    for (run = 0; run < LAT_RUNS; run++) {
+	mem_reset_brk();
+	if (mm->init() < 0)
+	    app_error("mm_init failed in eval_mm_latency");
+
+	for (i = 0;  i < n;  i++) {
+	    index = trace->ops[i].index;
+	    clock_gettime(CLOCK_MONOTONIC, &t0);
+	    switch (trace->ops[i].type) {
+
+	    case ALLOC: /* mm_malloc */
+		if ((p = mm->malloc(trace->ops[i].size)) == NULL)
+		    app_error("mm_malloc failed in eval_mm_latency");
+		trace->blocks[index] = p;
+		break;
+
+	    case REALLOC: /* mm_realloc */
+		if ((p = mm->realloc(trace->blocks[index], 
+				    trace->ops[i].size)) == NULL)
+		    app_error("mm_realloc failed in eval_mm_latency");
+		trace->blocks[index] = p;
+		break;
+
+	    case FREE: /* mm_free */
+		mm->free(trace->blocks[index]);
+		break;
+
+	    default: /* region requests */
+		if (!region_op(trace, &trace->ops[i], 0))
+		    app_error("region request failed in eval_mm_latency");
+	    }
+	    clock_gettime(CLOCK_MONOTONIC, &t1);
+	    t = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+	    if (run == 0 || t < ns[i])
+		ns[i] = t;
+	}
+    }
+    stats->lat_heap = mem_heapsize();
+
+    qsort(ns, n, sizeof(double), cmp_double);
+    stats->lat_p50 = ns[(int)(0.50 * (n-1))];
+    stats->lat_p99 = ns[(int)(0.99 * (n-1))];
+    stats->lat_p999 = ns[(int)(0.999 * (n-1))];
+    stats->lat_max = ns[n-1];
+    free(ns);
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
  *    We'll be conservative and terminate if any libc malloc call fails.
  *
@@ -861,8 +2028,11 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
 	    free(trace->blocks[trace->ops[i].index]);
 	    break;
 
-	default:
-	    app_error("invalid operation type  in eval_libc_valid");
+	default: /* region requests, with malloc and free */
+	    if (!region_op(trace, &trace->ops[i], 1)) {
+		malloc_error(tracenum, i, "libc malloc failed");
+		unix_error("System message");
+	    }
 	}
     }
 
@@ -906,70 +2076,1821 @@ static void eval_libc_speed(void *ptr)
 	    block = trace->blocks[index];
 	    free(block);
 	    break;
+
+	default: /* region requests, with malloc and free */
+	    if (!region_op(trace, &trace->ops[i], 1))
+		unix_error("malloc failed in eval_libc_speed");
 	}
     }
 }
 
-/*************************************
- * Some miscellaneous helper routines
- ************************************/
+/*
+ * eval_libc_trace - Check libc malloc for correctness on one trace
+ *     and measure its running time
+ */
+static void eval_libc_trace(char *tracefile, int tracenum, stats_t *stats)
+{
+    trace_t *trace;
+    speed_t speed_params;
 
+    trace = read_trace(tracedir, tracefile);
+    stats->ops = trace->num_ops;
+    stats->weight = trace_weight(trace, tracenum);
+    if (verbose > 1)
+	printf("Checking libc malloc for correctness, ");
+    stats->valid = eval_libc_valid(trace, tracenum);
+    if (stats->valid) {
+	speed_params.trace = trace;
+	if (verbose > 1)
+	    printf("and performance.\n");
+	pin_cpu(timing_cpu);
+	stats->secs = fsecs(eval_libc_speed, &speed_params);
+	stats->ci = fsecs_ci();
+	if (use_perfctr) {
+	    perfctr_start();
+	    eval_libc_speed(&speed_params);
+	    perfctr_stop(&stats->pc);
+	}
+    }
+    free_trace(trace);
+}
 
 /*
- * printresults - prints a performance summary for some malloc package
+ * eval_mm_trace - Check the mm malloc package for correctness on one
+ *     trace, then measure its space utilization and running time
  */
-static void printresults(int n, stats_t *stats) 
+static void eval_mm_trace(char *tracefile, int tracenum, stats_t *stats,
+			  range_t **ranges)
 {
-    int i;
-    double secs = 0;
-    double ops = 0;
-    double util = 0;
+    trace_t *trace;
+    speed_t speed_params;
 
-    /* Print the individual results for each trace */
-    printf("%5s%7s %5s%8s%10s%6s\n", 
-	   "trace", " valid", "util", "ops", "secs", "Kops");
-    for (i=0; i < n; i++) {
-	if (stats[i].valid) {
-	    printf("%2d%10s%5.0f%%%8.0f%10.6f%6.0f\n", 
-		   i,
-		   "yes",
-		   stats[i].util*100.0,
-		   stats[i].ops,
-		   stats[i].secs,
-		   (stats[i].ops/1e3)/stats[i].secs);
-	    secs += stats[i].secs;
-	    ops += stats[i].ops;
-	    util += stats[i].util;
-	}
-	else {
-	    printf("%2d%10s%6s%8s%10s%6s\n", 
-		   i,
-		   "no",
-		   "-",
-		   "-",
-		   "-",
-		   "-");
+    trace = read_trace(tracedir, tracefile);
+    stats->ops = trace->num_ops;
+    stats->weight = trace_weight(trace, tracenum);
+    if (verbose > 1)
+	printf("Checking mm_malloc for correctness, ");
+    stats->valid = eval_mm_valid(trace, tracenum, ranges);
+    if (stats->valid) {
+	if (verbose > 1)
+	    printf("efficiency, ");
+	stats->util = eval_mm_util(trace, tracenum, ranges);
+	if (frag_every > 0)
+	    eval_mm_frag(trace, tracefile);
+	if (map_every > 0 || num_map_ops > 0)
+	    eval_mm_map(trace, tracefile);
+	speed_params.trace = trace;
+	speed_params.ranges = *ranges;
+	if (verbose > 1)
+	    printf("and performance.\n");
+	pin_cpu(timing_cpu);
+	stats->secs = fsecs(eval_mm_speed, &speed_params);
+	stats->ci = fsecs_ci();
+	if (use_perfctr) {
+	    perfctr_start();
+	    eval_mm_speed(&speed_params);
+	    perfctr_stop(&stats->pc);
 	}
+	if (use_latency)
+	    eval_mm_latency(trace, stats);
     }
+    free_trace(trace);
+}
 
-    /* Print the aggregate results for the set of traces */
-    if (errors == 0) {
-	printf("%12s%5.0f%%%8.0f%10.6f%6.0f\n", 
-	       "Total       ",
-	       (util/n)*100.0,
-	       ops, 
-	       secs,
-	       (ops/1e3)/secs);
-    }
-    else {
-	printf("%12s%6s%8s%10s%6s\n", 
-	       "Total       ",
-	       "-", 
-	       "-", 
-	       "-", 
-	       "-");
+/*
+ * eval_hugepages - Measure the throughput of the mm package on each
+ *     valid trace twice, with the simulated heap on regular pages and
+ *     then on huge pages (-H thp or -H hugetlb), and with -P count the
+ *     dTLB misses of each run. Reports how much of the heap the kernel
+ *     actually backed with huge pages, since THP is only a hint.
+ */
+static void eval_hugepages(char **tracefiles, int num_tracefiles,
+			   stats_t *stats, int flags)
+{
+    trace_t *trace;
+    speed_t speed_params;
+    perfctr_t pc;
+    double kops[2], dtlb[2];
+    size_t huge_bytes = 0;
+    int i, k;
+
+    printf("\nRegular vs huge pages (%s):\n", 
+	   (flags & MEM_HUGETLB) ? "hugetlb" : "thp");
+    printf("%-20s%8s%8s%8s", "trace", "Kops", "huge", "change");
+    if (use_perfctr)
+	printf("%10s%10s", "dTLB/op", "huge");
+    printf("%10s\n", "huge KB");
+
+    for (i = 0; i < num_tracefiles; i++) {
+	if (!stats[i].valid)
+	    continue;
+	trace = read_trace(tracedir, tracefiles[i]);
+	speed_params.trace = trace;
+	speed_params.ranges = NULL;
+
+	for (k = 0; k < 2; k++) {
+	    mem_deinit();
+	    mem_set_flags(heap_flags | (k ? flags : 0));
+	    mem_init();
+	    pin_cpu(timing_cpu);
+	    kops[k] = (trace->num_ops/1e3) / fsecs(eval_mm_speed, &speed_params);
+	    dtlb[k] = -1;
+	    if (use_perfctr) {
+		perfctr_start();
+		eval_mm_speed(&speed_params);
+		perfctr_stop(&pc);
+		if (pc.count[PC_DTLB_MISSES] >= 0)
+		    dtlb[k] = pc.count[PC_DTLB_MISSES] / trace->num_ops;
+	    }
+	    if (k)
+		huge_bytes = mem_hugepage_bytes();
+	}
+
+	printf("%-20s%8.0f%8.0f%7.1f%%", trace_name(tracefiles[i]), 
+	       kops[0], kops[1], 100.0 * (kops[1] - kops[0]) / kops[0]);
+	if (use_perfctr) {
+	    for (k = 0; k < 2; k++) {
+		if (dtlb[k] >= 0)
+		    printf("%10.4f", dtlb[k]);
+		else
+		    printf("%10s", "-");
+	    }
+	}
+	printf("%10lu\n", (unsigned long)(huge_bytes / 1024));
+	free_trace(trace);
     }
 
+    /* Put the heap back on regular pages */
+    mem_deinit();
+    mem_set_flags(heap_flags);
+    mem_init();
+}
+
+/*
+ * eval_coldstart - Measure the throughput of the mm package on each
+ *     valid trace on a new heap: the first run, which takes a page
+ *     fault on every page that mem_sbrk hands out, and the runs after
+ *     it, timed like the main table. Then the same again on a heap
+ *     prefaulted at mem_init (and locked, with --mlock), where the
+ *     first run only finds the caches cold. Reports the page faults
+ *     taken by each first run.
+ */
+static void eval_coldstart(char **tracefiles, int num_tracefiles,
+			   stats_t *stats)
+{
+    trace_t *trace;
+    speed_t speed_params;
+    struct rusage ru;
+    double first[2], steady[2], start;
+    long faults[2];
+    int i, k;
+
+    printf("\nFirst run vs steady state on a new heap, Kops:\n");
+    printf("%-20s%8s%8s%8s%10s%8s%8s\n", "trace", "first", "steady", 
+	   "faults", "prefault", "steady", "faults");
+
+    for (i = 0; i < num_tracefiles; i++) {
+	if (!stats[i].valid)
+	    continue;
+	trace = read_trace(tracedir, tracefiles[i]);
+	speed_params.trace = trace;
+	speed_params.ranges = NULL;
+
+	for (k = 0; k < 2; k++) {
+	    mem_deinit();
+	    mem_set_flags(k ? (heap_flags | MEM_PREFAULT) : 0);
+	    mem_init();
+	    pin_cpu(timing_cpu);
+	    getrusage(RUSAGE_SELF, &ru);
+	    faults[k] = ru.ru_minflt + ru.ru_majflt;
+	    start = mono_secs();
+	    eval_mm_speed(&speed_params);
+	    first[k] = (trace->num_ops/1e3) / (mono_secs() - start);
+	    getrusage(RUSAGE_SELF, &ru);
+	    faults[k] = ru.ru_minflt + ru.ru_majflt - faults[k];
+	    steady[k] = (trace->num_ops/1e3) / fsecs(eval_mm_speed, &speed_params);
+	}
+
+	printf("%-20s%8.0f%8.0f%8ld%10.0f%8.0f%8ld\n", 
+	       trace_name(tracefiles[i]), first[0], steady[0], faults[0],
+	       first[1], steady[1], faults[1]);
+	free_trace(trace);
+    }
+
+    mem_deinit();
+    mem_set_flags(heap_flags);
+    mem_init();
+}
+
+/*
+ * eval_sites - Replay each valid trace once with every malloc charged
+ *     to the call site the trace gives it (0 if none), and print the
+ *     sites that cost the most time. Then time the trace with site
+ *     profiling of one call in SITE_SAMPLE, and of every call, against
+ *     plain mm_malloc, to show what the profiling costs.
+ */
+static void eval_sites(char **tracefiles, int num_tracefiles, stats_t *stats)
+{
+    trace_t *trace;
+    speed_t speed_params;
+    double plain, sampled, every;
+    int i;
+
+    for (i = 0; i < num_tracefiles; i++) {
+	if (!stats[i].valid)
+	    continue;
+	trace = read_trace(tracedir, tracefiles[i]);
+	speed_params.trace = trace;
+	speed_params.ranges = NULL;
+
+	printf("\nCall sites of %s:\n", trace_name(tracefiles[i]));
+	mm->site_sample(1);
+	eval_site_speed(&speed_params);
+	mm->site_dump(stdout, site_top);
+
+	pin_cpu(timing_cpu);
+	plain = fsecs(eval_mm_speed, &speed_params);
+	mm->site_sample(SITE_SAMPLE);
+	sampled = fsecs(eval_site_speed, &speed_params);
+	mm->site_sample(1);
+	every = fsecs(eval_site_speed, &speed_params);
+	printf("Kops %.0f plain, %.0f profiling 1 in %d calls (%+.1f%% time), "
+	       "%.0f profiling all (%+.1f%% time)\n", 
+	       trace->num_ops/1e3/plain, trace->num_ops/1e3/sampled, SITE_SAMPLE,
+	       100.0 * (sampled/plain - 1), trace->num_ops/1e3/every,
+	       100.0 * (every/plain - 1));
+	free_trace(trace);
+    }
+}
+
+/*
+ * eval_steady - Measure the steady-state throughput of the mm package
+ *     on each valid trace. The first steady_pct% of the trace is
+ *     replayed once on a new heap, untimed. The heap and the
+ *     allocator's state as it leaves them are the snapshot: each of
+ *     STEADY_RUNS forked children times the rest of the trace from a
+ *     copy of it, and the fastest child is kept. The full-trace Kops of
+ *     the main table, which include the warm-up, are printed alongside.
+ *     A rest of fewer than STEADY_MIN_OPS ops is not timed.
+ */
+static void eval_steady(char **tracefiles, int num_tracefiles, stats_t *stats)
+{
+    trace_t *trace;
+    double secs, best;
+    int i, k, lo;
+
+    printf("\nSteady state from a snapshot after %d%% of each trace, Kops:\n",
+	   steady_pct);
+    printf("%-20s%10s%10s%10s%10s%8s\n", "trace", "snapshot", "heap KB", 
+	   "full", "steady", "ratio");
+
+    for (i = 0; i < num_tracefiles; i++) {
+	if (!stats[i].valid)
+	    continue;
+	trace = read_trace(tracedir, tracefiles[i]);
+	lo = (int)((double)trace->num_ops * steady_pct / 100);
+
+	/* Take the snapshot */
+	mem_reset_brk();
+	if (mm->init() < 0)
+	    app_error("mm_init failed in eval_steady");
+	replay_ops(trace, 0, lo);
+
+	best = -1;
+	for (k = 0; k < STEADY_RUNS && trace->num_ops - lo >= STEADY_MIN_OPS; k++)
+	    if ((secs = time_suffix(trace, lo)) >= 0 && 
+		(best < 0 || secs < best))
+		best = secs;
+	if (trace->num_ops - lo < STEADY_MIN_OPS)
+	    printf("%-20s%10d%10.1f%10.0f%10s%8s\n", trace_name(tracefiles[i]),
+		   lo, mem_heapsize()/1024.0, stats[i].ops/stats[i].secs/1e3,
+		   "-", "-");
+	else if (best < 0) {
+	    sprintf(msg, "no snapshot of %s could be timed", tracefiles[i]);
+	    malloc_error(i, lo, msg);
+	}
+	else
+	    printf("%-20s%10d%10.1f%10.0f%10.0f%7.2fx\n", 
+		   trace_name(tracefiles[i]), lo, mem_heapsize()/1024.0,
+		   stats[i].ops/stats[i].secs/1e3,
+		   (trace->num_ops - lo)/best/1e3, 
+		   ((trace->num_ops - lo)/best) / (stats[i].ops/stats[i].secs));
+	free_trace(trace);
+    }
+}
+
+/*
+ * time_suffix - Fork a child that times requests lo.. of the trace on
+ *     its copy of the heap, and return its seconds, or -1 if it died.
+ *     Before the clock starts, the child writes every page of the heap,
+ *     of the block table and of the allocator's own state (mm->touch:
+ *     its globals, tables and side arrays) back to itself, so that the
+ *     copy-on-write faults of the fork are not timed, and then reads the
+ *     live part of the heap once more, so that it is in cache as in a
+ *     timed run.
+ */
+static double time_suffix(trace_t *trace, int lo)
+{
+    volatile char *heap = (volatile char *)mem_heap_lo();
+    volatile char *blocks = (volatile char *)trace->blocks;
+    size_t off, pg = mem_pagesize(), used = mem_heapsize();
+    int fds[2], status;
+    double secs, start;
+    pid_t pid;
+
+    if (pipe(fds) < 0)
+	unix_error("pipe failed in time_suffix");
+    fflush(stdout);
+    if ((pid = fork()) < 0)
+	unix_error("fork failed in time_suffix");
+
+    if (pid == 0) { /* child */
+	close(fds[0]);
+	for (off = 0; off < MAX_HEAP; off += pg)
+	    heap[off] = heap[off];
+	for (off = 0; off < trace->num_ids * sizeof(char *); off += pg)
+	    blocks[off] = blocks[off];
+	mm->touch();
+	for (off = 0; off < used; off += 64)
+	    (void)heap[off];
+	pin_cpu(timing_cpu);
+	start = mono_secs();
+	replay_ops(trace, lo, trace->num_ops);
+	secs = mono_secs() - start;
+	if (write(fds[1], &secs, sizeof(secs)) != sizeof(secs))
+	    unix_error("write failed in time_suffix");
+	_exit(0);
+    }
+
+    close(fds[1]);
+    if (read(fds[0], &secs, sizeof(secs)) != sizeof(secs))
+	secs = -1;
+    close(fds[0]);
+    if (waitpid(pid, &status, 0) < 0)
+	unix_error("waitpid failed in time_suffix");
+    return secs;
+}
+
+/*
+ * eval_persist - For each valid trace without region requests, replay
+ *     the first PERSIST_PCT% of it on a heap in persist_file, fill each
+ *     live block with its id, and mm_sync. Then map the file again
+ *     somewhere else and have mm_init reattach to the heap, check that
+ *     every live block still holds its id, and replay the rest of the
+ *     trace on it. Reports the time to build the heap, to sync it and to
+ *     reattach to it. Needs mm.c built with make PERSIST=1, which main
+ *     checks through mm_features (MM_PERSIST).
+ */
+static void eval_persist(char **tracefiles, int num_tracefiles, stats_t *stats)
+{
+    trace_t *trace;
+    char *live, *old_lo, *hold, *p;
+    double start, build, sync, attach;
+    size_t pg = mem_pagesize(), kept;
+    int i, j, k, lo, ret, bad;
+
+    printf("\nHeap kept in %s after %d%% of each trace:\n", persist_file,
+	   PERSIST_PCT);
+    printf("%-20s%10s%10s%12s%10s%14s\n", "trace", "live", "heap KB",
+	   "build ms", "sync ms", "reattach us");
+
+    for (i = 0; i < num_tracefiles; i++) {
+	if (!stats[i].valid)
+	    continue;
+	trace = read_trace(tracedir, tracefiles[i]);
+	if (trace->regions != NULL) {
+	    printf("%-20s  has region requests, skipped\n", 
+		   trace_name(tracefiles[i]));
+	    free_trace(trace);
+	    continue;
+	}
+	lo = (int)((double)trace->num_ops * PERSIST_PCT / 100);
+	if ((live = (char *)calloc(trace->num_ids, 1)) == NULL)
+	    unix_error("calloc failed in eval_persist");
+
+	/* Build the heap in the file */
+	mem_deinit();
+	mem_set_file(persist_file);
+	mem_init();
+	start = mono_secs();
+	mem_reset_brk();
+	if (mm->init() < 0)
+	    app_error("mm_init failed in eval_persist");
+	replay_ops(trace, 0, lo);
+	build = mono_secs() - start;
+	kept = mem_heapsize();
+
+	for (j = 0; j < lo; j++)
+	    if (trace->ops[j].type == ALLOC || trace->ops[j].type == REALLOC) {
+		live[trace->ops[j].index] = 1;
+		trace->block_sizes[trace->ops[j].index] = trace->ops[j].size;
+	    }
+	    else if (trace->ops[j].type == FREE)
+		live[trace->ops[j].index] = 0;
+	for (k = j = 0; j < trace->num_ids; j++)
+	    if (live[j]) {
+		memset(trace->blocks[j], j & 0xFF, trace->block_sizes[j]);
+		k++;
+	    }
+	start = mono_secs();
+	if (mm->sync() < 0)
+	    app_error("mm_sync failed in eval_persist");
+	sync = mono_secs() - start;
+
+	/* Map the file again, where the old heap was not */
+	old_lo = mem_heap_lo();
+	mem_deinit();
+	hold = mmap(old_lo - pg, pg + MAX_HEAP, PROT_NONE, 
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	mem_init();
+	if (hold != MAP_FAILED)
+	    munmap(hold, pg + MAX_HEAP);
+	start = mono_secs();
+	ret = mm->init();
+	attach = mono_secs() - start;
+	if (ret != 1) {
+	    sprintf(msg, "%s malloc did not reattach to the heap in %s", 
+		    mm->name, persist_file);
+	    malloc_error(i, lo, msg);
+	    free(live);
+	    free_trace(trace);
+	    break;
+	}
+
+	/* The blocks moved with the heap */
+	for (bad = j = 0; j < trace->num_ids; j++)
+	    if (live[j]) {
+		p = (char *)mem_heap_lo() + (trace->blocks[j] - old_lo);
+		trace->blocks[j] = p;
+		for (k = 0; k < trace->block_sizes[j]; k++)
+		    if ((unsigned char)p[k] != (j & 0xFF)) {
+			bad++;
+			break;
+		    }
+	    }
+	if (bad) {
+	    sprintf(msg, "%d blocks lost their data in the reattached heap", bad);
+	    malloc_error(i, lo, msg);
+	}
+	else
+	    replay_ops(trace, lo, trace->num_ops);
+
+	for (k = j = 0; j < trace->num_ids; j++)
+	    k += live[j];
+	printf("%-20s%10d%10.1f%12.2f%10.2f%14.1f\n", trace_name(tracefiles[i]),
+	       k, kept/1024.0, build * 1e3, sync * 1e3, attach * 1e6);
+	free(live);
+	free_trace(trace);
+    }
+
+    mem_deinit();
+    mem_set_file(NULL);
+    mem_init();
+}
+
+/*
+ * eval_parallel - Evaluate every trace in its own worker process, with
+ *     its own memlib heap. At most one worker per timing cpu runs at a
+ *     time (and at most njobs, if njobs > 0), and each worker pins its
+ *     timed phase to its own cpu so the workers don't disturb each
+ *     other's throughput. The timing cpus are the isolated ones 
+ *     (isolcpus=) if there are any, otherwise every cpu we may use.
+ *     The workers send their stats back over a pipe.
+ */
+typedef struct {
+    stats_t stats;  /* the worker's stats for its trace */
+    int errors;     /* number of errors the worker found */
+} result_t;
+
+static void eval_parallel(char **tracefiles, int num_tracefiles, 
+			  stats_t *stats, int libc, int njobs)
+{
+    int *cpus, *slot_trace, *slot_fd;
+    pid_t *slot_pid, pid;
+    int fds[2];
+    int ncpus, nslots, running, next, i, status;
+    range_t *ranges = NULL;
+    result_t result;
+
+    if ((cpus = (int *)malloc(CPU_SETSIZE * sizeof(int))) == NULL)
+	unix_error("malloc failed in eval_parallel");
+    if ((ncpus = timing_cpus(cpus)) == 0)
+	cpus[ncpus++] = -1;
+    nslots = (njobs > 0 && njobs < ncpus) ? njobs : ncpus;
+    if (verbose)
+	printf("Evaluating %d traces in up to %d worker processes\n",
+	       num_tracefiles, nslots);
+
+    slot_trace = (int *)malloc(nslots * sizeof(int));
+    slot_fd = (int *)malloc(nslots * sizeof(int));
+    slot_pid = (pid_t *)malloc(nslots * sizeof(pid_t));
+    if (!slot_trace || !slot_fd || !slot_pid)
+	unix_error("malloc failed in eval_parallel");
+    for (i = 0; i < nslots; i++)
+	slot_pid[i] = 0;
+
+    next = 0;
+    running = 0;
+    while (next < num_tracefiles || running > 0) {
+
+	/* Start a worker in every free slot */
+	for (i = 0; i < nslots && next < num_tracefiles; i++) {
+	    if (slot_pid[i] != 0)
+		continue;
+	    if (pipe(fds) < 0)
+		unix_error("pipe failed in eval_parallel");
+	    fflush(stdout);
+	    if ((pid = fork()) < 0)
+		unix_error("fork failed in eval_parallel");
+
+	    if (pid == 0) { /* worker */
+		close(fds[0]);
+		timing_cpu = cpus[i];
+		errors = 0;
+		if (use_perfctr) { /* counters follow the thread that opened them */
+		    perfctr_deinit();
+		    perfctr_init();
+		}
+		memset(&result, 0, sizeof(result));
+		if (libc)
+		    eval_libc_trace(tracefiles[next], next, &result.stats);
+		else {
+		    mem_deinit();
+		    mem_init();
+		    eval_mm_trace(tracefiles[next], next, &result.stats, &ranges);
+		}
+		result.errors = errors;
+		if (write(fds[1], &result, sizeof(result)) != sizeof(result))
+		    unix_error("write failed in eval_parallel");
+		fflush(stdout);
+		_exit(0);
+	    }
+
+	    close(fds[1]);
+	    slot_pid[i] = pid;
+	    slot_fd[i] = fds[0];
+	    slot_trace[i] = next++;
+	    running++;
+	}
+
+	/* Collect the next worker that finishes */
+	if ((pid = wait(&status)) < 0)
+	    unix_error("wait failed in eval_parallel");
+	for (i = 0; i < nslots && slot_pid[i] != pid; i++)
+	    ;
+	if (i == nslots)
+	    continue;
+	if (read(slot_fd[i], &result, sizeof(result)) == sizeof(result)) {
+	    stats[slot_trace[i]] = result.stats;
+	    errors += result.errors;
+	}
+	else { /* the worker died before it could report */
+	    sprintf(msg, "worker for %s terminated abnormally", 
+		    tracefiles[slot_trace[i]]);
+	    malloc_error(slot_trace[i], 0, msg);
+	    stats[slot_trace[i]].valid = 0;
+	}
+	close(slot_fd[i]);
+	slot_pid[i] = 0;
+	running--;
+    }
+
+    free(cpus);
+    free(slot_trace);
+    free(slot_fd);
+    free(slot_pid);
+}
+
+/*********************************************************************
+ * The following routines replay traces concurrently on N pinned
+ * threads to see where an allocator stops scaling. A trace is either
+ * partitioned by alloc id (thread t gets every op whose id is t mod N,
+ * so each block is allocated, reallocated and freed by one thread) or,
+ * with -p, every thread replays its own whole trace. With -X the frees
+ * go to the next thread instead (id+1 mod N), which hands every block
+ * to another thread to free, like a producer/consumer queue.
+ ********************************************************************/
+
+/*
+ * split_trace - Return the share of trace that thread t of nthreads
+ *     replays. Every share gets its own blocks arrays, so threads never
+ *     write to the same slots. If seq is not NULL (-X), frees are
+ *     replayed on the next thread, the shares use trace's blocks array,
+ *     and *seq gets each op's position among the ops on its id, which
+ *     replay_thread uses to keep the ops on one id in trace order.
+ *     All the requests on a region go to the thread of its region id.
+ */
+static trace_t *split_trace(trace_t *trace, int t, int nthreads, int **seq)
+{
+    trace_t *part;
+    int *count = NULL;
+    int i, n, owner;
+
+    if ((part = (trace_t *)malloc(sizeof(trace_t))) == NULL)
+	unix_error("malloc 1 failed in split_trace");
+    *part = *trace;
+    if ((part->ops = 
+	 (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
+	unix_error("malloc 2 failed in split_trace");
+    if (seq) {
+	part->blocks = trace->blocks;
+	part->block_sizes = NULL;
+	if ((*seq = (int *)malloc(trace->num_ops * sizeof(int))) == NULL ||
+	    (count = (int *)calloc(trace->num_ids, sizeof(int))) == NULL)
+	    unix_error("malloc 3 failed in split_trace");
+    }
+    else {
+	if ((part->blocks = 
+	     (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
+	    unix_error("malloc 3 failed in split_trace");
+	if ((part->block_sizes = 
+	     (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
+	    unix_error("malloc 4 failed in split_trace");
+    }
+
+    n = 0;
+    for (i = 0; i < trace->num_ops; i++) {
+	owner = trace->ops[i].index;
+	if (trace->ops[i].type == REGION_ALLOC)
+	    owner = trace->ops[i].region;  /* a region stays on one thread */
+	else if (seq && trace->ops[i].type == FREE)
+	    owner++;
+	if (nthreads == 1 || owner % nthreads == t) {
+	    if (seq)
+		(*seq)[n] = count[trace->ops[i].index];
+	    part->ops[n++] = trace->ops[i];
+	}
+	if (seq)
+	    count[trace->ops[i].index]++;
+    }
+    part->num_ops = n;
+    alloc_regions(part);
+    free(count);
+    return part;
+}
+
+/*
+ * replay_thread - Body of one replay thread: pin, wait at the barrier
+ *     for the others, then run through this thread's ops.
+ */
+static void *replay_thread(void *arg)
+{
+    thread_t *thr = (thread_t *)arg;
+    trace_t *trace = thr->trace;
+    int i, index, spins;
+    char *p;
+
+    pin_cpu(thr->cpu);
+
+    pthread_barrier_wait(thr->barrier);
+    thr->start = mono_secs();
+    for (i = 0;  i < trace->num_ops;  i++) {
+	index = trace->ops[i].index;
+
+	/* 
+	 * -X: wait until the ops before this one on the same id are done,
+	 * by whichever thread. Every thread replays its ops in trace order,
+	 * so the earliest op not yet done can always go ahead.
+	 */
+	if (thr->stage) {
+	    for (spins = 0; __atomic_load_n(&thr->stage[index], __ATOMIC_ACQUIRE) 
+		     != thr->seq[i]; spins++)
+		if (spins >= 1000)
+		    sched_yield();
+	}
+
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* malloc */
+	    p = thr->libc ? malloc(trace->ops[i].size) : 
+		mm->malloc(trace->ops[i].size);
+	    if (p == NULL)
+		app_error("malloc failed in replay_thread");
+	    trace->blocks[index] = p;
+	    break;
+
+	case REALLOC: /* realloc */
+	    p = thr->libc ? realloc(trace->blocks[index], trace->ops[i].size) :
+		mm->realloc(trace->blocks[index], trace->ops[i].size);
+	    if (p == NULL)
+		app_error("realloc failed in replay_thread");
+	    trace->blocks[index] = p;
+	    break;
+
+        case FREE: /* free */
+	    if (thr->libc)
+		free(trace->blocks[index]);
+	    else
+		mm->free(trace->blocks[index]);
+	    break;
+
+	default: /* region requests */
+	    if (!region_op(trace, &trace->ops[i], thr->libc))
+		app_error("region request failed in replay_thread");
+	}
+
+	if (thr->stage)
+	    __atomic_store_n(&thr->stage[index], thr->seq[i] + 1, 
+			     __ATOMIC_RELEASE);
+    }
+    thr->end = mono_secs();
+    return NULL;
+}
+
+/*
+ * run_threads - Replay parts[0..nthreads-1] concurrently, one thread 
+ *     each, pinned round-robin to the cpus we are allowed to run on.
+ *     Returns the wall time from the first start to the last finish
+ *     in *wall and each thread's own time in thr_secs[]. If seqs is
+ *     not NULL (-X), the parts come from split_trace with seqs[i] and
+ *     share one blocks array.
+ */
+static int run_threads(trace_t **parts, int **seqs, int nthreads, int libc,
+		       double *wall, double *thr_secs)
+{
+    pthread_t *tids;
+    thread_t *thrs;
+    pthread_barrier_t barrier;
+    int *cpus, *stage = NULL;
+    int i, ncpus;
+    double first, last;
+
+    /* Collect the cpus this process may run on */
+    if ((cpus = (int *)malloc(CPU_SETSIZE * sizeof(int))) == NULL)
+	unix_error("malloc failed in run_threads");
+    ncpus = allowed_cpus(cpus);
+
+    tids = (pthread_t *)malloc(nthreads * sizeof(pthread_t));
+    thrs = (thread_t *)malloc(nthreads * sizeof(thread_t));
+    if (tids == NULL || thrs == NULL)
+	unix_error("malloc failed in run_threads");
+    if (seqs && 
+	(stage = (int *)calloc(parts[0]->num_ids, sizeof(int))) == NULL)
+	unix_error("calloc failed in run_threads");
+
+    /* Start from an empty heap, like eval_mm_speed does */
+    if (!libc) {
+	mem_reset_brk();
+	if (mm->init() < 0)
+	    app_error("mm_init failed in run_threads");
+    }
+
+    pthread_barrier_init(&barrier, NULL, nthreads);
+    for (i = 0; i < nthreads; i++) {
+	thrs[i].trace = parts[i];
+	thrs[i].seq = seqs ? seqs[i] : NULL;
+	thrs[i].stage = stage;
+	thrs[i].cpu = (ncpus > 0) ? cpus[i % ncpus] : -1;
+	thrs[i].libc = libc;
+	thrs[i].barrier = &barrier;
+	if ((errno = pthread_create(&tids[i], NULL, replay_thread, &thrs[i])))
+	    unix_error("pthread_create failed in run_threads");
+    }
+    for (i = 0; i < nthreads; i++)
+	pthread_join(tids[i], NULL);
+    pthread_barrier_destroy(&barrier);
+
+    first = thrs[0].start;
+    last = thrs[0].end;
+    for (i = 0; i < nthreads; i++) {
+	thr_secs[i] = thrs[i].end - thrs[i].start;
+	first = (thrs[i].start < first) ? thrs[i].start : first;
+	last = (thrs[i].end > last) ? thrs[i].end : last;
+    }
+    *wall = last - first;
+
+    free(cpus);
+    free(tids);
+    free(thrs);
+    free(stage);
+    return ncpus;
+}
+
+/*
+ * eval_threads - Replay the traces on 1, 2, 4, ... maxthreads threads 
+ *     and print the aggregate and per-thread throughput for each count.
+ *     With cross set (-X), each block is freed by a different thread
+ *     than the one that allocated it.
+ *     Each configuration is run THREAD_TRIALS times and the fastest
+ *     run is reported.
+ */
+#define THREAD_TRIALS 3
+
+static void eval_threads(char **tracefiles, int num_tracefiles, 
+			 int maxthreads, int per_thread, int cross, int libc)
+{
+    trace_t **traces, **parts;
+    int **seqs;
+    double *thr_secs, *best_secs;
+    double wall, best_wall, ops, thr_kops, base_kops = 0;
+    int i, t, n, trial, ncpus = 0;
+    int rows = per_thread ? 1 : num_tracefiles;
+
+    traces = (trace_t **)malloc(num_tracefiles * sizeof(trace_t *));
+    parts = (trace_t **)malloc(maxthreads * sizeof(trace_t *));
+    thr_secs = (double *)malloc(maxthreads * sizeof(double));
+    best_secs = (double *)malloc(maxthreads * sizeof(double));
+    seqs = (int **)malloc(maxthreads * sizeof(int *));
+    if (!traces || !parts || !thr_secs || !best_secs || !seqs)
+	unix_error("malloc failed in eval_threads");
+    for (i = 0; i < num_tracefiles; i++)
+	traces[i] = read_trace(tracedir, tracefiles[i]);
+
+    printf("\nThread scaling for %s malloc (%s):\n", libc ? "libc" : mm->name,
+	   per_thread ? "one trace per thread" : 
+	   cross ? "traces split by alloc id, frees on the next thread" :
+	   "traces split by alloc id");
+    printf("%5s%8s%9s%10s%8s%10s%8s\n", 
+	   "trace", "threads", "ops", "secs", "Kops", "Kops/thr", "speedup");
+
+    for (i = 0; i < rows; i++) {
+	for (n = 1; ; n = (2*n < maxthreads) ? 2*n : maxthreads) {
+
+	    /* Hand each thread its share of the work */
+	    ops = 0;
+	    for (t = 0; t < n; t++) {
+		parts[t] = per_thread ? 
+		    split_trace(traces[t % num_tracefiles], 0, 1, NULL) :
+		    split_trace(traces[i], t, n, cross ? &seqs[t] : NULL);
+		ops += parts[t]->num_ops;
+	    }
+
+	    /* Keep the fastest of a few trials */
+	    best_wall = DBL_MAX;
+	    for (trial = 0; trial < THREAD_TRIALS; trial++) {
+		ncpus = run_threads(parts, (cross && !per_thread) ? seqs : NULL,
+				    n, libc, &wall, thr_secs);
+		if (wall < best_wall) {
+		    best_wall = wall;
+		    memcpy(best_secs, thr_secs, n * sizeof(double));
+		}
+	    }
+
+	    /* Average throughput of one thread */
+	    thr_kops = 0;
+	    for (t = 0; t < n; t++) {
+		thr_kops += (parts[t]->num_ops/1e3)/best_secs[t] / n;
+		if (cross && !per_thread) {
+		    parts[t]->blocks = NULL; /* traces[i]'s */
+		    free(seqs[t]);
+		}
+		free_trace(parts[t]);
+	    }
+	    if (n == 1)
+		base_kops = (ops/1e3)/best_wall;
+
+	    if (per_thread)
+		printf("%5s", "all");
+	    else
+		printf("%5d", i);
+	    printf("%8d%9.0f%10.6f%8.0f%10.0f%7.2fx\n", 
+		   n, ops, best_wall, (ops/1e3)/best_wall, thr_kops,
+		   ((ops/1e3)/best_wall)/base_kops);
+	    if (n == maxthreads)
+		break;
+	}
+    }
+    if (ncpus > 0 && maxthreads > ncpus)
+	printf("Note: only %d cpus available, threads share cpus above that.\n", 
+	       ncpus);
+
+    for (i = 0; i < num_tracefiles; i++)
+	free_trace(traces[i]);
+    free(traces);
+    free(parts);
+    free(thr_secs);
+    free(best_secs);
+    free(seqs);
+}
+
+/*********************************************************************
+ * The following routines replay a trace on several processes that
+ * share one heap in a shared memory object (--procs), split by alloc id
+ * as for -T, and with -X each block is freed by the next process: a
+ * producer hands a buffer to a consumer with no copy. The processes
+ * map the heap at different addresses, so they pass blocks to each
+ * other as heap offsets.
+ ********************************************************************/
+
+/*
+ * shared_calloc - Return size zeroed bytes that forked children share
+ */
+static void *shared_calloc(size_t size)
+{
+    void *p;
+
+    p = mmap(NULL, size ? size : 1, PROT_READ | PROT_WRITE, 
+	     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+	unix_error("mmap failed in shared_calloc");
+    return p;
+}
+
+/*
+ * replay_proc - Body of one replay process: map the heap again, away
+ *     from where the parent has it, reattach the allocator to it, pin,
+ *     wait at the barrier for the others, then run through this
+ *     process's ops. Like replay_thread, but blocks go through offs.
+ */
+static void replay_proc(void *arg)
+{
+    proc_t *proc = (proc_t *)arg;
+    trace_t *trace = proc->trace;
+    char *lo, *p, *hold, *old_lo = mem_heap_lo();
+    size_t pg = mem_pagesize();
+    int i, index, spins;
+
+    mem_deinit();
+    hold = mmap(old_lo - pg, pg + MAX_HEAP, PROT_NONE, 
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    mem_init();
+    if (hold != MAP_FAILED)
+	munmap(hold, pg + MAX_HEAP);
+    if (mm->init() != 1)
+	app_error("mm_init did not reattach to the shared heap in replay_proc");
+    lo = mem_heap_lo();
+
+    pin_cpu(proc->cpu);
+
+    pthread_barrier_wait(proc->barrier);
+    *proc->start = mono_secs();
+    for (i = 0;  i < trace->num_ops;  i++) {
+	index = trace->ops[i].index;
+
+	/* -X: wait until the ops before this one on the same id are done */
+	if (proc->seq) {
+	    for (spins = 0; __atomic_load_n(&proc->stage[index], __ATOMIC_ACQUIRE) 
+		     != proc->seq[i]; spins++)
+		if (spins >= 1000)
+		    sched_yield();
+	}
+
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* mm_malloc */
+	    if ((p = mm->malloc(trace->ops[i].size)) == NULL)
+		app_error("mm_malloc failed in replay_proc");
+	    proc->offs[index] = p - lo;
+	    break;
+
+	case REALLOC: /* mm_realloc */
+	    if ((p = mm->realloc(lo + proc->offs[index], 
+				 trace->ops[i].size)) == NULL)
+		app_error("mm_realloc failed in replay_proc");
+	    proc->offs[index] = p - lo;
+	    break;
+
+        case FREE: /* mm_free */
+	    mm->free(lo + proc->offs[index]);
+	    break;
+
+	default: /* region requests, all on the process of the region */
+	    if (!region_op(trace, &trace->ops[i], 0))
+		app_error("region request failed in replay_proc");
+	}
+
+	if (proc->seq)
+	    __atomic_store_n(&proc->stage[index], proc->seq[i] + 1, 
+			     __ATOMIC_RELEASE);
+    }
+    *proc->end = mono_secs();
+}
+
+/*
+ * run_procs - Replay parts[0..nprocs-1] concurrently on a new heap, one
+ *     forked process each, pinned round-robin to the cpus we are allowed
+ *     to run on. Returns the number of those cpus, with the wall time
+ *     from the first start to the last finish in *wall, or -1 if a
+ *     process failed, in which case the others are killed.
+ */
+static int run_procs(trace_t **parts, int **seqs, int nprocs, double *wall)
+{
+    int num_ids = parts[0]->num_ids;
+    pthread_barrierattr_t attr;
+    pthread_barrier_t *barrier;
+    double *times;
+    int *cpus, *stage;
+    size_t *offs;
+    proc_t proc;
+    pid_t *pids, pid;
+    int i, ncpus, status, failed = 0, running;
+
+    if ((cpus = (int *)malloc(CPU_SETSIZE * sizeof(int))) == NULL ||
+	(pids = (pid_t *)malloc(nprocs * sizeof(pid_t))) == NULL)
+	unix_error("malloc failed in run_procs");
+    ncpus = allowed_cpus(cpus);
+    barrier = (pthread_barrier_t *)shared_calloc(sizeof(pthread_barrier_t));
+    times = (double *)shared_calloc(2 * nprocs * sizeof(double));
+    stage = (int *)shared_calloc(num_ids * sizeof(int));
+    offs = (size_t *)shared_calloc(num_ids * sizeof(size_t));
+    pthread_barrierattr_init(&attr);
+    pthread_barrierattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_barrier_init(barrier, &attr, nprocs);
+    pthread_barrierattr_destroy(&attr);
+
+    /* Start from an empty heap, like eval_mm_speed does */
+    mem_reset_brk();
+    if (mm->init() < 0)
+	app_error("mm_init failed in run_procs");
+
+    fflush(stdout);
+    for (i = 0; i < nprocs; i++) {
+	proc.trace = parts[i];
+	proc.seq = seqs ? seqs[i] : NULL;
+	proc.stage = stage;
+	proc.offs = offs;
+	proc.cpu = (ncpus > 0) ? cpus[i % ncpus] : -1;
+	proc.barrier = barrier;
+	proc.start = &times[2*i];
+	proc.end = &times[2*i + 1];
+	if ((pids[i] = fork()) < 0)
+	    unix_error("fork failed in run_procs");
+	if (pids[i] == 0) {
+	    replay_proc(&proc);
+	    fflush(stdout);
+	    _exit(0);
+	}
+    }
+
+    /* A process that fails leaves the others waiting for it forever */
+    for (running = nprocs; running > 0; running--) {
+	if ((pid = wait(&status)) < 0)
+	    unix_error("wait failed in run_procs");
+	if ((!WIFEXITED(status) || WEXITSTATUS(status) != 0) && !failed) {
+	    failed = 1;
+	    for (i = 0; i < nprocs; i++)
+		if (pids[i] != pid)
+		    kill(pids[i], SIGKILL);
+	}
+    }
+
+    *wall = 0;
+    if (!failed) {
+	double first = times[0], last = times[1];
+
+	for (i = 0; i < nprocs; i++) {
+	    first = (times[2*i] < first) ? times[2*i] : first;
+	    last = (times[2*i + 1] > last) ? times[2*i + 1] : last;
+	}
+	*wall = last - first;
+    }
+
+    pthread_barrier_destroy(barrier);
+    munmap(barrier, sizeof(pthread_barrier_t));
+    munmap(times, 2 * nprocs * sizeof(double));
+    munmap(stage, num_ids ? num_ids * sizeof(int) : 1);
+    munmap(offs, num_ids ? num_ids * sizeof(size_t) : 1);
+    free(cpus);
+    free(pids);
+    return failed ? -1 : ncpus;
+}
+
+/*
+ * kill_holder - On a new shared heap, fork a process that dies in
+ *     mm_free holding the heap's lock: it makes the heap above a guard
+ *     page read-only in its own mapping, so its first write there
+ *     faults. Unless broken is set, the block it frees lies above the
+ *     guard and the heap is left as it was; with broken set, the block
+ *     straddles the guard, so its header is written free but its
+ *     footer is not. Returns 1 if the process died of a signal.
+ */
+static int kill_holder(int broken)
+{
+    size_t pg = mem_pagesize();
+    char *p, *q, *guard, *end;
+    int status;
+    pid_t pid;
+
+    mem_reset_brk();
+    if (mm->init() < 0)
+	app_error("mm_init failed in kill_holder");
+    if ((p = mm->malloc(2 * pg)) == NULL || (q = mm->malloc(64)) == NULL)
+	app_error("mm_malloc failed in kill_holder");
+    guard = (char *)(((size_t)p + pg) & ~(pg - 1));
+    end = (char *)mem_heap_hi() + 1;
+
+    fflush(stdout);
+    if ((pid = fork()) < 0)
+	unix_error("fork failed in kill_holder");
+    if (pid == 0) {
+	signal(SIGSEGV, SIG_DFL);
+	if (mprotect(guard, end - guard, PROT_READ) < 0)
+	    _exit(1);
+	mm->free(broken ? p : q);
+	_exit(0);
+    }
+    if (waitpid(pid, &status, 0) < 0)
+	unix_error("waitpid failed in kill_holder");
+    return WIFSIGNALED(status);
+}
+
+/*
+ * eval_dead_holder - Kill a process inside the heap's lock, once with
+ *     the heap whole and once with a block half freed, and check what
+ *     the next process to take the lock makes of it: the whole heap
+ *     goes on, the broken one is poisoned, so that malloc fails and
+ *     mm_init refuses to reattach until the heap is made anew.
+ */
+static void eval_dead_holder(void)
+{
+    void *p;
+
+    if (!kill_holder(0))
+	app_error("kill_holder: the lock holder did not die");
+    if ((p = mm->malloc(64)) == NULL)
+	app_error("mm_malloc failed after the lock holder died on a whole heap");
+    mm->free(p);
+    printf("Lock holder killed in mm_free, heap whole: recovered\n");
+
+    if (!kill_holder(1))
+	app_error("kill_holder: the lock holder did not die");
+    if (mm->malloc(64) != NULL)
+	app_error("mm_malloc did not fail after the lock holder died breaking the heap");
+    if (mm->init() >= 0)
+	app_error("mm_init reattached to a poisoned heap");
+    mem_reset_brk();
+    if (mm->init() < 0 || (p = mm->malloc(64)) == NULL)
+	app_error("mm_init could not make a new heap over a poisoned one");
+    mm->free(p);
+    printf("Lock holder killed in mm_free, heap broken: poisoned until made anew\n");
+}
+
+/*
+ * eval_procs - Replay the traces on 1, 2, 4, ... maxprocs processes
+ *     that share one heap in a shared memory object, and print the
+ *     aggregate throughput for each count. With cross set (-X), each
+ *     block is freed by another process than the one that allocated
+ *     it. The allocator has to reattach to a heap that another process
+ *     made (mm_init returns 1), and its lock has to work across
+ *     processes: mm.c does both when built with make PERSIST=1
+ *     THREAD_SAFE=1, and main refuses --procs on a build whose
+ *     mm_features lacks MM_PERSIST or MM_THREAD_SAFE. First, eval_dead_holder checks that a process
+ *     killed holding the lock does not leave the others on a broken heap.
+ *     Each configuration is run THREAD_TRIALS times and the fastest
+ *     run is reported.
+ */
+static void eval_procs(char **tracefiles, int num_tracefiles, 
+		       int maxprocs, int cross)
+{
+    trace_t *trace, **parts;
+    int **seqs;
+    char name[MAXLINE];
+    double wall, best_wall, ops, base_kops = 0;
+    int i, t, n, trial, ncpus = 0;
+
+    parts = (trace_t **)malloc(maxprocs * sizeof(trace_t *));
+    seqs = (int **)malloc(maxprocs * sizeof(int *));
+    if (!parts || !seqs)
+	unix_error("malloc failed in eval_procs");
+
+    /* Put the heap in a shared memory object, and reattach mm to it */
+    sprintf(name, "/mdriver.%d", (int)getpid());
+    mem_deinit();
+    mem_set_shm(name);
+    mem_init();
+    mem_reset_brk();
+    if (mm->init() < 0)
+	app_error("mm_init failed in eval_procs");
+    mem_deinit();
+    mem_init();
+    if (mm->init() != 1)
+	app_error("mm_init did not reattach to the shared heap in eval_procs");
+    printf("\n");
+    eval_dead_holder();
+
+    printf("\nProcess scaling for %s malloc on one shared heap (%s):\n", 
+	   mm->name, cross ? "traces split by alloc id, frees on the next process" :
+	   "traces split by alloc id");
+    printf("%5s%8s%9s%10s%8s%8s\n", 
+	   "trace", "procs", "ops", "secs", "Kops", "speedup");
+
+    for (i = 0; i < num_tracefiles; i++) {
+	trace = read_trace(tracedir, tracefiles[i]);
+	for (n = 1; ; n = (2*n < maxprocs) ? 2*n : maxprocs) {
+
+	    /* Hand each process its share of the work */
+	    ops = 0;
+	    for (t = 0; t < n; t++) {
+		parts[t] = split_trace(trace, t, n, cross ? &seqs[t] : NULL);
+		ops += parts[t]->num_ops;
+	    }
+
+	    /* Keep the fastest of a few trials */
+	    best_wall = DBL_MAX;
+	    for (trial = 0; trial < THREAD_TRIALS; trial++) {
+		if ((ncpus = run_procs(parts, cross ? seqs : NULL, n, &wall)) < 0)
+		    break;
+		if (wall < best_wall)
+		    best_wall = wall;
+	    }
+
+	    for (t = 0; t < n; t++) {
+		if (cross) {
+		    parts[t]->blocks = NULL; /* trace's */
+		    free(seqs[t]);
+		}
+		free_trace(parts[t]);
+	    }
+	    if (ncpus < 0) {
+		sprintf(msg, "a process failed replaying %s on %d processes", 
+			tracefiles[i], n);
+		malloc_error(i, 0, msg);
+		break;
+	    }
+	    if (n == 1)
+		base_kops = (ops/1e3)/best_wall;
+
+	    printf("%5d%8d%9.0f%10.6f%8.0f%7.2fx\n", 
+		   i, n, ops, best_wall, (ops/1e3)/best_wall,
+		   ((ops/1e3)/best_wall)/base_kops);
+	    if (n == maxprocs)
+		break;
+	}
+	free_trace(trace);
+    }
+    if (ncpus > 0 && maxprocs > ncpus)
+	printf("Note: only %d cpus available, processes share cpus above that.\n", 
+	       ncpus);
+
+    mem_deinit();
+    shm_unlink(name);
+    mem_set_shm(NULL);
+    mem_init();
+    free(parts);
+    free(seqs);
+}
+
+/*********************************************************************
+ * The following routines save the results in machine-readable form
+ * (JSON or CSV) and compare them with the results of a saved run.
+ ********************************************************************/
+
+/*
+ * writeresults - Save the per-trace results for mm (and libc, if it
+ *     was run) to filename ("-" for stdout), as JSON or as CSV. The
+ *     JSON has one trace per line so read_baseline can scan it.
+ */
+static void writeresults(char *filename, int csv, char **tracefiles, int n,
+			 stats_t *mm_stats, stats_t *libc_stats, 
+			 double perfindex)
+{
+    FILE *fp;
+    stats_t *stats;
+    int i, j, k;
+    char *allocator;
+    double util = 0, ops = 0, secs = 0, weights = 0;
+
+    if (!strcmp(filename, "-"))
+	fp = stdout;
+    else if ((fp = fopen(filename, "w")) == NULL) {
+	sprintf(msg, "Could not open %s in writeresults", filename);
+	unix_error(msg);
+    }
+
+    for (i = 0; i < n; i++) {
+	util += mm_stats[i].weight * mm_stats[i].util;
+	ops += mm_stats[i].weight * mm_stats[i].ops;
+	secs += mm_stats[i].weight * mm_stats[i].secs;
+	weights += mm_stats[i].weight;
+    }
+
+    if (csv) {
+	fprintf(fp, "allocator,trace,valid,util,ops,secs,kops,ci,weight");
+	if (use_perfctr)
+	    for (j = 0; j < PC_NUM; j++)
+		fprintf(fp, ",%s_per_op", perfctr_name(j));
+	fprintf(fp, "\n");
+    }
+    else {
+	fprintf(fp, "{\n  \"perfindex\": %.1f,\n  \"util\": %.6f,\n"
+		"  \"kops\": %.3f,\n  \"errors\": %d,\n  \"traces\": [\n", 
+		perfindex, util/weights, (secs > 0) ? (ops/1e3)/secs : 0, errors);
+    }
+
+    for (k = 0; k < 2; k++) {
+	stats = k ? mm_stats : libc_stats;
+	allocator = k ? mm->name : "libc";
+	if (stats == NULL)
+	    continue;
+	for (i = 0; i < n; i++) {
+	    fprintf(fp, csv ? "%s,%s,%d,%.6f,%.0f,%.9f,%.3f,%.6f,%g" :
+		    "    {\"allocator\": \"%s\", \"trace\": \"%s\", "
+		    "\"valid\": %d, \"util\": %.6f, \"ops\": %.0f, "
+		    "\"secs\": %.9f, \"kops\": %.3f, \"ci\": %.6f, "
+		    "\"weight\": %g",
+		    allocator, trace_name(tracefiles[i]), stats[i].valid,
+		    stats[i].util, stats[i].ops, stats[i].secs,
+		    (stats[i].valid && stats[i].secs > 0) ? 
+		    (stats[i].ops/1e3)/stats[i].secs : 0, stats[i].ci,
+		    stats[i].weight);
+	    if (use_perfctr) {
+		for (j = 0; j < PC_NUM; j++) {
+		    double per_op = (stats[i].pc.count[j] >= 0) ?
+			stats[i].pc.count[j]/stats[i].ops : -1;
+		    if (csv)
+			fprintf(fp, ",%.6f", per_op);
+		    else
+			fprintf(fp, ", \"%s_per_op\": %.6f", 
+				perfctr_name(j), per_op);
+		}
+	    }
+	    if (csv)
+		fprintf(fp, "\n");
+	    else
+		fprintf(fp, "}%s\n", (k == 1 && i == n-1) ? "" : ",");
+	}
+    }
+
+    if (!csv)
+	fprintf(fp, "  ]\n}\n");
+    if (fp != stdout)
+	fclose(fp);
+}
+
+/*
+ * read_baseline - Read the results of the allocator being evaluated
+ *     (-A) from a run saved with --json or --csv into a new array
+ *     *base, and return the number of traces
+ */
+static int read_baseline(char *filename, baseline_t **base)
+{
+    FILE *fp;
+    char line[MAXLINE], *p, *q, *field;
+    char csv_key[MAXLINE], json_key[MAXLINE];
+    int n = 0, max = 16, col;
+    int cols[5] = {-1, -1, -1, -1, -1}; /* trace, valid, util, kops, ci */
+    int csv = -1;
+    baseline_t *b;
+
+    if ((fp = fopen(filename, "r")) == NULL) {
+	sprintf(msg, "Could not open %s in read_baseline", filename);
+	unix_error(msg);
+    }
+    if ((*base = (baseline_t *)malloc(max * sizeof(baseline_t))) == NULL)
+	unix_error("malloc failed in read_baseline");
+    sprintf(csv_key, "%s,", mm->name);
+    sprintf(json_key, "\"allocator\": \"%s\"", mm->name);
+
+    while (fgets(line, MAXLINE, fp) != NULL) {
+	if (csv < 0) { /* the first line tells us the format */
+	    csv = (line[strspn(line, " \t")] != '{');
+	    if (csv) { /* remember which column holds which field */
+		for (col = 0, p = strtok(line, ",\n"); p != NULL; 
+		     col++, p = strtok(NULL, ",\n")) {
+		    if (!strcmp(p, "trace")) cols[0] = col;
+		    if (!strcmp(p, "valid")) cols[1] = col;
+		    if (!strcmp(p, "util")) cols[2] = col;
+		    if (!strcmp(p, "kops")) cols[3] = col;
+		    if (!strcmp(p, "ci")) cols[4] = col;
+		}
+		if (cols[0] < 0 || cols[3] < 0)
+		    app_error("Baseline CSV needs trace and kops columns");
+	    }
+	    continue;
+	}
+
+	if (n == max) {
+	    max *= 2;
+	    if ((*base = realloc(*base, max * sizeof(baseline_t))) == NULL)
+		unix_error("realloc failed in read_baseline");
+	}
+	b = &(*base)[n];
+	memset(b, 0, sizeof(baseline_t));
+
+	if (csv) {
+	    if (strncmp(line, csv_key, strlen(csv_key)))
+		continue;
+	    for (col = 0, p = line; p != NULL; col++, p = q) {
+		if ((q = strchr(p, ',')) != NULL)
+		    *q++ = '\0';
+		field = p;
+		if (col == cols[0]) {
+		    snprintf(b->name, MAXLINE, "%s", field);
+		    b->name[strcspn(b->name, "\n")] = '\0';
+		}
+		if (col == cols[1]) b->valid = atoi(field);
+		if (col == cols[2]) b->util = atof(field);
+		if (col == cols[3]) b->kops = atof(field);
+		if (col == cols[4]) b->ci = atof(field);
+	    }
+	}
+	else {
+	    if (strstr(line, json_key) == NULL ||
+		(p = strstr(line, "\"trace\": \"")) == NULL)
+		continue;
+	    p += strlen("\"trace\": \"");
+	    snprintf(b->name, MAXLINE, "%s", p);
+	    b->name[strcspn(b->name, "\"")] = '\0';
+	    b->valid = (int)json_number(line, "valid");
+	    b->util = json_number(line, "util");
+	    b->kops = json_number(line, "kops");
+	    b->ci = json_number(line, "ci");
+	}
+	n++;
+    }
+    fclose(fp);
+    return n;
+}
+
+/*
+ * compare_baseline - Compare the mm results with a saved run and 
+ *     return the number of regressions. A trace regresses if its 
+ *     utilization dropped by more than REGRESS_UTIL, or if its 
+ *     throughput dropped by more than REGRESS_THRU and by more than 
+ *     the combined uncertainties (fsecs_ci) of the two runs, which are
+ *     those of the estimates compared, K-best minima by default.
+ *     A baseline row with no positive Kops, or a negative util or
+ *     uncertainty, is skipped like an invalid one.
+ */
+static int compare_baseline(char *filename, char **tracefiles, int n, 
+			    stats_t *stats)
+{
+    baseline_t *base;
+    int nbase, i, j, regressions = 0;
+    double kops, change, noise;
+    char *verdict;
+
+    nbase = read_baseline(filename, &base);
+
+    printf("\nComparison with baseline %s:\n", filename);
+    printf("%-20s%6s%6s%8s%8s%8s%7s  %s\n", 
+	   "trace", "util", "base", "Kops", "base", "change", "+/-", "");
+    for (i = 0; i < n; i++) {
+	for (j = 0; j < nbase; j++)
+	    if (!strcmp(base[j].name, trace_name(tracefiles[i])))
+		break;
+	printf("%-20s", trace_name(tracefiles[i]));
+
+	/* A hand-edited or truncated baseline row is no baseline */
+	if (j < nbase && base[j].valid && 
+	    !(base[j].kops > 0 && base[j].ci >= 0 && base[j].util >= 0)) {
+	    printf("%6s%6s%8s%8s%8s%7s  %s\n", "-", "-", "-", "-", "-", "-",
+		   "bad baseline row");
+	    continue;
+	}
+	if (j == nbase || !base[j].valid || !stats[i].valid) {
+	    printf("%6s%6s%8s%8s%8s%7s  %s\n", "-", "-", "-", "-", "-", "-",
+		   (j == nbase) ? "not in baseline" : 
+		   (!stats[i].valid ? "INVALID" : ""));
+	    regressions += (j < nbase && base[j].valid && !stats[i].valid);
+	    continue;
+	}
+
+	kops = (stats[i].ops/1e3)/stats[i].secs;
+	change = (kops - base[j].kops) / base[j].kops;
+	noise = sqrt(stats[i].ci*stats[i].ci + base[j].ci*base[j].ci);
+	verdict = "";
+	if (stats[i].util < base[j].util - REGRESS_UTIL) {
+	    verdict = "REGRESSION (util)";
+	    regressions++;
+	}
+	else if (change < -REGRESS_THRU && -change > noise) {
+	    verdict = "REGRESSION (thru)";
+	    regressions++;
+	}
+	else if (change > REGRESS_THRU && change > noise)
+	    verdict = "faster";
+	printf("%5.0f%%%5.0f%%%8.0f%8.0f%7.1f%%%6.1f%%  %s\n",
+	       stats[i].util*100.0, base[j].util*100.0, kops, base[j].kops,
+	       change*100.0, noise*100.0, verdict);
+    }
+    printf("%d regression%s against baseline\n", 
+	   regressions, (regressions == 1) ? "" : "s");
+
+    free(base);
+    return regressions;
+}
+
+/*
+ * read_manifest - Read a trace manifest. Each line names one trace,
+ *     relative to the current directory, optionally followed by its
+ *     weight (default 1) and the targets it should meet:
+ *
+ *         <path> [<weight>] [util=<min util>] [kops=<min Kops/sec>]
+ *
+ *     Blank lines and lines starting with '#' are ignored. Sets
+ *     *tracefiles and targets[], and returns the number of traces.
+ */
+static int read_manifest(char *filename, char ***tracefiles)
+{
+    FILE *fp;
+    char line[MAXLINE], *tok;
+    int n = 0, max = 16;
+    target_t *t;
+
+    if ((fp = fopen(filename, "r")) == NULL) {
+	sprintf(msg, "Could not open %s in read_manifest", filename);
+	unix_error(msg);
+    }
+    if ((*tracefiles = (char **)malloc((max+1) * sizeof(char *))) == NULL ||
+	(targets = (target_t *)malloc(max * sizeof(target_t))) == NULL)
+	unix_error("malloc failed in read_manifest");
+
+    while (fgets(line, MAXLINE, fp) != NULL) {
+	if ((tok = strtok(line, " \t\n")) == NULL || tok[0] == '#')
+	    continue;
+	if (n == max) {
+	    max *= 2;
+	    if ((*tracefiles = realloc(*tracefiles, (max+1) * sizeof(char *))) == NULL ||
+		(targets = realloc(targets, max * sizeof(target_t))) == NULL)
+		unix_error("realloc failed in read_manifest");
+	}
+	(*tracefiles)[n] = strdup(tok);
+	t = &targets[n];
+	t->weight = 1;
+	t->util = 0;
+	t->kops = 0;
+	while ((tok = strtok(NULL, " \t\n")) != NULL) {
+	    if (!strncmp(tok, "util=", 5))
+		t->util = atof(tok + 5);
+	    else if (!strncmp(tok, "kops=", 5))
+		t->kops = atof(tok + 5);
+	    else if ((t->weight = atof(tok)) <= 0) {
+		sprintf(msg, "Bad weight for %s in manifest %s", 
+			(*tracefiles)[n], filename);
+		app_error(msg);
+	    }
+	}
+	n++;
+    }
+    fclose(fp);
+    if (n == 0) {
+	sprintf(msg, "No traces in manifest %s", filename);
+	app_error(msg);
+    }
+    (*tracefiles)[n] = NULL;
+    return n;
+}
+
+/*
+ * check_targets - Compare each trace's util and throughput with its
+ *     targets in the manifest and return the number of misses
+ */
+static int check_targets(char **tracefiles, int n, stats_t *stats)
+{
+    int i, missed = 0;
+    double kops;
+    char *verdict;
+
+    for (i = 0; i < n; i++)
+	if (targets[i].util > 0 || targets[i].kops > 0)
+	    break;
+    if (i == n) /* the manifest has weights only */
+	return 0;
+
+    printf("\nManifest targets:\n");
+    printf("%-20s%7s%6s%8s%8s  %s\n", 
+	   "trace", "weight", "util", "target", "Kops", "target");
+    for (i = 0; i < n; i++) {
+	kops = (stats[i].valid && stats[i].secs > 0) ? 
+	    (stats[i].ops/1e3)/stats[i].secs : 0;
+	verdict = "";
+	if (!stats[i].valid)
+	    verdict = "INVALID";
+	else if (stats[i].util < targets[i].util)
+	    verdict = "MISSED (util)";
+	else if (kops < targets[i].kops)
+	    verdict = "MISSED (thru)";
+	missed += (verdict[0] != '\0');
+	printf("%-20s%7g%5.0f%%", trace_name(tracefiles[i]), 
+	       targets[i].weight, stats[i].util*100.0);
+	if (targets[i].util > 0)
+	    printf("%7.0f%%", targets[i].util*100.0);
+	else
+	    printf("%8s", "-");
+	printf("%8.0f", kops);
+	if (targets[i].kops > 0)
+	    printf("%8.0f", targets[i].kops);
+	else
+	    printf("%8s", "-");
+	printf("  %s\n", verdict);
+    }
+    printf("%d target%s missed\n", missed, (missed == 1) ? "" : "s");
+    return missed;
+}
+
+/*
+ * trace_name - Return the file name part of a trace file path
+ */
+static char *trace_name(char *tracefile)
+{
+    char *p = strrchr(tracefile, '/');
+    return p ? p+1 : tracefile;
+}
+
+/*
+ * json_number - Return the number following "key": in line (0 if the
+ *     key isn't there)
+ */
+static double json_number(char *line, char *key)
+{
+    char pattern[MAXLINE];
+    char *p;
+
+    sprintf(pattern, "\"%s\":", key);
+    if ((p = strstr(line, pattern)) == NULL)
+	return 0;
+    return atof(p + strlen(pattern));
+}
+
+/*************************************
+ * Some miscellaneous helper routines
+ ************************************/
+
+/*
+ * allowed_cpus - Store the cpus this process may run on in cpus[] 
+ *     and return how many there are
+ */
+static int allowed_cpus(int *cpus)
+{
+    cpu_set_t allowed;
+    int i, n = 0;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+	for (i = 0; i < CPU_SETSIZE; i++)
+	    if (CPU_ISSET(i, &allowed))
+		cpus[n++] = i;
+    return n;
+}
+
+/*
+ * timing_cpus - Store the cpus to run timed phases on in cpus[] and
+ *     return how many there are: the isolated cpus if the kernel was
+ *     booted with isolcpus=, otherwise the allowed ones.
+ */
+static int timing_cpus(int *cpus)
+{
+    FILE *fp;
+    char line[MAXLINE], *p;
+    int lo, hi, n = 0;
+
+    if ((fp = fopen("/sys/devices/system/cpu/isolated", "r")) != NULL) {
+	if (fgets(line, MAXLINE, fp) != NULL) {
+	    /* The list looks like "2-5,7" */
+	    for (p = strtok(line, ",\n"); p != NULL; p = strtok(NULL, ",\n")) {
+		if (sscanf(p, "%d-%d", &lo, &hi) == 1)
+		    hi = lo;
+		for ( ; lo <= hi && n < CPU_SETSIZE; lo++)
+		    cpus[n++] = lo;
+	    }
+	}
+	fclose(fp);
+    }
+    return (n > 0) ? n : allowed_cpus(cpus);
+}
+
+/*
+ * pin_cpu - Bind the calling thread to one cpu (ignored if cpu < 0)
+ */
+static void pin_cpu(int cpu)
+{
+    cpu_set_t cpus;
+
+    if (cpu < 0)
+	return;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    if (sched_setaffinity(0, sizeof(cpus), &cpus) < 0 && verbose > 1)
+	printf("Could not pin to cpu %d: %s\n", cpu, strerror(errno));
+}
+
+/*
+ * mono_secs - Return the monotonic clock in seconds
+ */
+static double mono_secs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+/*
+ * printresults - prints a performance summary for some malloc package
+ */
+static void printresults(int n, stats_t *stats) 
+{
+    int i;
+    double secs = 0;
+    double ops = 0;
+    double util = 0;
+    double weights = 0;
+
+    /* Print the individual results for each trace */
+    printf("%5s%7s %5s%8s%10s%6s%7s\n", 
+	   "trace", " valid", "util", "ops", "secs", "Kops", "+/-");
+    for (i=0; i < n; i++) {
+	if (stats[i].valid) {
+	    printf("%2d%10s%5.0f%%%8.0f%10.6f%6.0f", 
+		   i,
+		   "yes",
+		   stats[i].util*100.0,
+		   stats[i].ops,
+		   stats[i].secs,
+		   (stats[i].ops/1e3)/stats[i].secs);
+	    if (stats[i].ci > 0)
+		printf("%6.1f%%\n", stats[i].ci*100.0);
+	    else
+		printf("%7s\n", "-");
+	    secs += stats[i].weight * stats[i].secs;
+	    ops += stats[i].weight * stats[i].ops;
+	    util += stats[i].weight * stats[i].util;
+	    weights += stats[i].weight;
+	}
+	else {
+	    printf("%2d%10s%6s%8s%10s%6s%7s\n", 
+		   i,
+		   "no",
+		   "-",
+		   "-",
+		   "-",
+		   "-",
+		   "-");
+	}
+    }
+
+    /* Print the aggregate results for the set of traces, weighted */
+    if (errors == 0) {
+	printf("%12s%5.0f%%%8.0f%10.6f%6.0f\n", 
+	       targets ? "Weighted    " : "Total       ",
+	       (util/weights)*100.0,
+	       ops, 
+	       secs,
+	       (ops/1e3)/secs);
+    }
+    else {
+	printf("%12s%6s%8s%10s%6s\n", 
+	       "Total       ",
+	       "-", 
+	       "-", 
+	       "-", 
+	       "-");
+    }
+
+}
+
+/*
+ * printcounters - prints the hardware event counts per op for some
+ *     malloc package, next to its throughput
+ */
+static void printcounters(int n, stats_t *stats)
+{
+    int i, j;
+    double *c;
+
+    printf("%5s%8s%8s%6s", "trace", "Kops", "cyc/op", "IPC");
+    for (j = PC_L1D_MISSES; j < PC_NUM; j++)
+	printf("%5s/op", perfctr_name(j));
+    printf("\n");
+
+    for (i=0; i < n; i++) {
+	printf("%2d", i);
+	if (!stats[i].valid) {
+	    printf("%11s\n", "-");
+	    continue;
+	}
+	c = stats[i].pc.count;
+	printf("%11.0f", (stats[i].ops/1e3)/stats[i].secs);
+	if (c[PC_CYCLES] >= 0)
+	    printf("%8.1f", c[PC_CYCLES]/stats[i].ops);
+	else
+	    printf("%8s", "-");
+	if (c[PC_CYCLES] > 0 && c[PC_INSTRUCTIONS] >= 0)
+	    printf("%6.2f", c[PC_INSTRUCTIONS]/c[PC_CYCLES]);
+	else
+	    printf("%6s", "-");
+	for (j = PC_L1D_MISSES; j < PC_NUM; j++) {
+	    if (c[j] >= 0)
+		printf("%8.3f", c[j]/stats[i].ops);
+	    else
+		printf("%8s", "-");
+	}
+	printf("\n");
+    }
+}
+
+/*
+ * printlatency - prints the per-op latency percentiles of the mm
+ *     package next to the heap size, to show whether the tail grows
+ *     with the heap
+ */
+static void printlatency(int n, stats_t *stats)
+{
+    int i;
+
+    printf("%5s%10s%10s%8s%8s%8s%8s\n", 
+	   "trace", "ops", "heap KB", "p50", "p99", "p99.9", "max");
+    for (i=0; i < n; i++) {
+	printf("%2d", i);
+	if (!stats[i].valid) {
+	    printf("%13s\n", "-");
+	    continue;
+	}
+	printf("%13.0f%10.0f%8.0f%8.0f%8.0f%8.0f\n", stats[i].ops, 
+	       stats[i].lat_heap/1024, stats[i].lat_p50, stats[i].lat_p99,
+	       stats[i].lat_p999, stats[i].lat_max);
+    }
 }
 
 /* 
@@ -1004,14 +3925,53 @@ void malloc_error(int tracenum, int opnum, char *msg)
  */
 static void usage(void) 
 {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvValpPX] [-f <file>] [-t <dir>] [-T <n>] [-j <n>]\n");
+    fprintf(stderr, "               [-A mm|buddy] [-H thp|hugetlb] [--cold] [--prefault] [--mlock]\n");
+    fprintf(stderr, "               [--sites <n>] [--steady <pct>] [--persist <file>]\n");
+    fprintf(stderr, "               [--procs <n>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-a         Don't check the team structure.\n");
+    fprintf(stderr, "\t-A <name>  Evaluate the mm (mm.c) or buddy (mm_buddy.c) allocator.\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-H <how>   Compare throughput (and dTLB misses with -P) with the\n");
+    fprintf(stderr, "\t           heap on transparent (thp) or hugetlb huge pages.\n");
+    fprintf(stderr, "\t-j <n>     Evaluate traces in <n> parallel workers (0 = one per cpu).\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-p         With -T, give every thread its own trace.\n");
+    fprintf(stderr, "\t-P         Count hardware events per op (perf_event_open).\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+    fprintf(stderr, "\t-T <n>     Also replay traces on 1, 2, 4, ... <n> threads\n");
+    fprintf(stderr, "\t           (make THREAD_SAFE=1).\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
+    fprintf(stderr, "\t-X         With -T (--procs), free every block on another thread (process).\n");
+    fprintf(stderr, "\t           -T -X needs make REMOTE_FREE=1.\n");
+    fprintf(stderr, "\t--json <file>      Save the results as JSON (- for stdout).\n");
+    fprintf(stderr, "\t--csv <file>       Save the results as CSV (- for stdout).\n");
+    fprintf(stderr, "\t--manifest <file>  Run the traces listed in <file>, one per line as\n");
+    fprintf(stderr, "\t                   <path> [weight] [util=<min>] [kops=<min>], and\n");
+    fprintf(stderr, "\t                   weight the scores; exit with status 2 on a miss.\n");
+    fprintf(stderr, "\t--baseline <file>  Compare with results saved by --json/--csv;\n");
+    fprintf(stderr, "\t                   exit with status 2 on any regression.\n");
+    fprintf(stderr, "\t--latency          Time every op; print p50/p99/p99.9/max per trace.\n");
+    fprintf(stderr, "\t--cold             Print the first run on a new heap apart from the\n");
+    fprintf(stderr, "\t                   steady state, with and without prefaulting.\n");
+    fprintf(stderr, "\t--prefault         Fault in the whole heap before any run.\n");
+    fprintf(stderr, "\t--mlock            Fault in and mlock the whole heap before any run.\n");
+    fprintf(stderr, "\t--sites <n>        Print the <n> call sites of each trace that cost the\n");
+    fprintf(stderr, "\t                   most time, and the overhead of site profiling\n");
+    fprintf(stderr, "\t                   (make SITE_PROFILE=1).\n");
+    fprintf(stderr, "\t--steady <pct>     Time the rest of each trace from a snapshot of the\n");
+    fprintf(stderr, "\t                   heap after its first <pct>%% of ops.\n");
+    fprintf(stderr, "\t--persist <file>   Keep half of each trace's heap in <file>, reattach\n");
+    fprintf(stderr, "\t                   to it at another address and finish the trace.\n");
+    fprintf(stderr, "\t--procs <n>        Also replay traces on 1, 2, 4, ... <n> processes that\n");
+    fprintf(stderr, "\t                   share one heap in shared memory (make PERSIST=1\n");
+    fprintf(stderr, "\t                   THREAD_SAFE=1).\n");
+    fprintf(stderr, "\t--frag <n>         Sample the heap's fragmentation every <n> ops.\n");
+    fprintf(stderr, "\t--frag-dir <dir>   Directory for --frag and --map output (default .).\n");
+    fprintf(stderr, "\t--map-at <ops>     Dump a heap map after each op in a comma separated list.\n");
+    fprintf(stderr, "\t--map-every <n>    Dump a heap map every <n> ops (view with mapview).\n");
 }
@@ -7,9 +7,12 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <unistd.h>
+#include <stdint.h>
 #include <sys/mman.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 
 #include "memlib.h"
 #include "config.h"
@@ -18,20 +21,104 @@
 static char *mem_start_brk;  /* points to first byte of heap */
 static char *mem_brk;        /* points to last byte of heap */
 static char *mem_max_addr;   /* largest legal heap address */ 
+static int mem_flags = 0;    /* MEM_xxx flags for the next mem_init */
+static size_t mem_map_len;   /* length of the heap mapping */
+
+/* 
+ * A heap file starts with a page that keeps the brk, so that the next
+ * mem_init on the same file finds the heap as it was left, and so that
+ * every process that maps it shares one brk. The heap itself follows
+ * that page. Its fields have fixed widths, so that a -m32 and a 64-bit
+ * build lay it out the same way.
+ */
+#define MEM_MAGIC 0x6d656d66  /* "memf" */
+
+typedef struct {
+    uint32_t magic;      /* MEM_MAGIC once the page is set up */
+    uint32_t pad;        /* keeps brk at offset 8 under -m32 too */
+    uint64_t brk;        /* mem_brk - mem_start_brk */
+} mem_hdr_t;
+
+_Static_assert(sizeof(mem_hdr_t) == 16, "mem_hdr_t must not depend on the ABI");
+
+static char *mem_file = NULL; /* heap file for the next mem_init, or NULL */
+static int mem_shm = 0;       /* mem_file names a shared memory object */
+static mem_hdr_t *mem_hdr;    /* its header page, or NULL if anonymous */
+
+static char *mem_map_huge(size_t *len);
+static char *mem_map_file(size_t *len);
+static void mem_prefault(void);
+static size_t hugepage_size(void);
+
+/*
+ * mem_set_flags - choose how the next mem_init backs the heap
+ */
+void mem_set_flags(int flags)
+{
+    mem_flags = flags;
+}
+
+/*
+ * mem_set_file - map the heap of the next mem_init from this file, or
+ *    from fresh anonymous memory again if path is NULL. The file is
+ *    created if need be, and a heap it already holds is kept.
+ */
+void mem_set_file(const char *path)
+{
+    free(mem_file);
+    mem_file = NULL;
+    mem_shm = 0;
+    if (path != NULL && (mem_file = strdup(path)) == NULL) {
+	fprintf(stderr, "mem_set_file: out of memory\n");
+	exit(1);
+    }
+}
+
+/*
+ * mem_set_shm - map the heap of the next mem_init from the POSIX shared
+ *    memory object name ("/name"), like a heap file, so that processes
+ *    that map the same object share the heap. shm_unlink removes it.
+ */
+void mem_set_shm(const char *name)
+{
+    mem_set_file(name);
+    mem_shm = (name != NULL);
+}
 
 /* 
  * mem_init - initialize the memory system model
  */
 void mem_init(void)
 {
-    /* allocate the storage we will use to model the available VM */
-    if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
-	fprintf(stderr, "mem_init_vm: malloc error\n");
-	exit(1);
+    /* 
+     * map the storage we will use to model the available VM. It starts
+     * on a page, so the heap layout doesn't depend on where it lands,
+     * and its pages are fresh after every mem_init, so the first run
+     * on a new heap takes its page faults the same way every time.
+     * A heap file (mem_set_file) is the exception: it keeps its heap
+     */
+    mem_hdr = NULL;
+    if (mem_file != NULL)
+	mem_start_brk = mem_map_file(&mem_map_len);
+    else if (mem_flags & (MEM_THP | MEM_HUGETLB))
+	mem_start_brk = mem_map_huge(&mem_map_len);
+    else {
+	mem_map_len = MAX_HEAP;
+	mem_start_brk = mmap(NULL, mem_map_len, PROT_READ | PROT_WRITE,
+			     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mem_start_brk == MAP_FAILED) {
+	    fprintf(stderr, "mem_init_vm: mmap error: %s\n", strerror(errno));
+	    exit(1);
+	}
     }
 
     mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
     mem_brk = mem_start_brk;                  /* heap is empty initially */
+    if (mem_hdr != NULL)                      /* unless the file has one */
+	mem_brk += mem_hdr->brk;
+
+    if (mem_flags & (MEM_PREFAULT | MEM_LOCK))
+	mem_prefault();
 }
 
 /* 
@@ -39,7 +126,180 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
-    free(mem_start_brk);
+    if (mem_hdr != NULL)
+	munmap(mem_hdr, mem_map_len);
+    else
+	munmap(mem_start_brk, mem_map_len);  /* unlocks it too */
+}
+
+/*
+ * mem_sync - write the heap file's changed pages back to it, up to the
+ *    brk, and return when they are there (0), or -1 on error. Nothing
+ *    to do for an anonymous heap.
+ */
+int mem_sync(void)
+{
+    size_t len;
+
+    if (mem_hdr == NULL)
+	return 0;
+    len = mem_pagesize() + mem_hdr->brk;
+    if (msync(mem_hdr, len, MS_SYNC) < 0) {
+	fprintf(stderr, "mem_sync: msync: %s\n", strerror(errno));
+	return -1;
+    }
+    return 0;
+}
+
+/*
+ * mem_map_file - map mem_file shared, its header page first, and return
+ *    the start of the heap with the length of the mapping in *len. A
+ *    new or foreign file gets an empty heap.
+ */
+static char *mem_map_file(size_t *len)
+{
+    size_t pg = mem_pagesize();
+    struct stat st;
+    char *p;
+    int fd;
+
+    *len = pg + MAX_HEAP;
+    fd = mem_shm ? shm_open(mem_file, O_RDWR | O_CREAT, 0666) :
+	open(mem_file, O_RDWR | O_CREAT, 0666);
+    if (fd < 0 || fstat(fd, &st) < 0) {
+	fprintf(stderr, "mem_init_vm: %s: %s\n", mem_file, strerror(errno));
+	exit(1);
+    }
+    if ((size_t)st.st_size < *len && ftruncate(fd, *len) < 0) {
+	fprintf(stderr, "mem_init_vm: ftruncate %s: %s\n", mem_file, 
+		strerror(errno));
+	exit(1);
+    }
+    p = mmap(NULL, *len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+	fprintf(stderr, "mem_init_vm: mmap %s: %s\n", mem_file, strerror(errno));
+	exit(1);
+    }
+    close(fd);
+
+    mem_hdr = (mem_hdr_t *)p;
+    if (mem_hdr->magic != MEM_MAGIC || mem_hdr->brk > MAX_HEAP) {
+	mem_hdr->brk = 0;
+	mem_hdr->magic = MEM_MAGIC;
+    }
+    return p + pg;
+}
+
+/*
+ * mem_prefault - fault in every page of the heap now, and with MEM_LOCK
+ *    lock them, so that the timed runs never take a page fault in
+ *    mem_sbrk's fresh memory. A failed mlock (RLIMIT_MEMLOCK, see 
+ *    ulimit -l) is reported and the pages are still faulted in.
+ */
+static void mem_prefault(void)
+{
+    size_t off, pg = mem_pagesize();
+
+    if ((mem_flags & MEM_LOCK) && mlock(mem_start_brk, MAX_HEAP) < 0)
+	fprintf(stderr, "mem_init_vm: mlock: %s, prefaulting only\n", 
+		strerror(errno));
+    for (off = 0; off < MAX_HEAP; off += pg)
+	if (mem_hdr != NULL) /* don't dirty, or clear, the file's heap */
+	    (void)((volatile char *)mem_start_brk)[off];
+	else
+	    mem_start_brk[off] = 0;
+}
+
+/*
+ * mem_map_huge - map the heap on huge pages, aligned to a huge page
+ *    boundary, and return it with the length of the mapping in *len
+ */
+static char *mem_map_huge(size_t *len)
+{
+    size_t hp = hugepage_size();
+    char *p, *start;
+
+    *len = (MAX_HEAP + hp - 1) / hp * hp;
+
+    if (mem_flags & MEM_HUGETLB) {
+#ifdef MAP_HUGETLB
+	p = mmap(NULL, *len, PROT_READ | PROT_WRITE, 
+		 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (p == MAP_FAILED) {
+	    fprintf(stderr, "mem_init_vm: no huge pages for a %lu-byte heap "
+		    "(see /proc/sys/vm/nr_hugepages): %s\n", 
+		    (unsigned long)*len, strerror(errno));
+	    exit(1);
+	}
+	return p;
+#else
+	fprintf(stderr, "mem_init_vm: MAP_HUGETLB is not supported here\n");
+	exit(1);
+#endif
+    }
+
+    /* Over-map by a huge page, then trim both ends to align the heap */
+    p = mmap(NULL, *len + hp, PROT_READ | PROT_WRITE, 
+	     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+	fprintf(stderr, "mem_init_vm: mmap error: %s\n", strerror(errno));
+	exit(1);
+    }
+    start = (char *)(((size_t)p + hp - 1) & ~(hp - 1));
+    if (start > p)
+	munmap(p, start - p);
+    munmap(start + *len, (p + hp) - start);
+#ifdef MADV_HUGEPAGE
+    if (madvise(start, *len, MADV_HUGEPAGE) < 0)
+	fprintf(stderr, "mem_init_vm: madvise(MADV_HUGEPAGE): %s\n", 
+		strerror(errno));
+#endif
+    return start;
+}
+
+/*
+ * hugepage_size - the default huge page size, from /proc/meminfo
+ */
+static size_t hugepage_size(void)
+{
+    FILE *fp;
+    char line[256];
+    unsigned long kb = 2048;
+
+    if ((fp = fopen("/proc/meminfo", "r")) != NULL) {
+	while (fgets(line, sizeof(line), fp) != NULL)
+	    if (sscanf(line, "Hugepagesize: %lu kB", &kb) == 1)
+		break;
+	fclose(fp);
+    }
+    return kb * 1024;
+}
+
+/*
+ * mem_hugepage_bytes - how much of the heap is backed by huge pages
+ *    right now, from the kernel's accounting in /proc/self/smaps
+ */
+size_t mem_hugepage_bytes(void)
+{
+    FILE *fp;
+    char line[256];
+    unsigned long lo, hi, kb;
+    size_t bytes = 0;
+    int in_heap = 0;
+
+    if ((fp = fopen("/proc/self/smaps", "r")) == NULL)
+	return 0;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+	if (sscanf(line, "%lx-%lx ", &lo, &hi) == 2)
+	    in_heap = (lo <= (unsigned long)mem_start_brk && 
+		       (unsigned long)mem_start_brk < hi);
+	else if (in_heap && 
+		 (sscanf(line, "AnonHugePages: %lu kB", &kb) == 1 ||
+		  sscanf(line, "Private_Hugetlb: %lu kB", &kb) == 1))
+	    bytes += kb * 1024;
+    }
+    fclose(fp);
+    return bytes;
 }
 
 /*
@@ -48,6 +308,8 @@ void mem_deinit(void)
 void mem_reset_brk()
 {
     mem_brk = mem_start_brk;
+    if (mem_hdr != NULL)
+	mem_hdr->brk = 0;
 }
 
 /* 
@@ -58,14 +320,28 @@ void mem_reset_brk()
 void *mem_sbrk(int incr) 
 {
     char *old_brk = mem_brk;
+    uint64_t brk;
 
-    if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
-	errno = ENOMEM;
-	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
-	return (void *)-1;
+    if (mem_hdr != NULL) { /* the brk is shared, other processes move it too */
+	brk = __atomic_load_n(&mem_hdr->brk, __ATOMIC_RELAXED);
+	do {
+	    if (incr < 0 || brk + incr > MAX_HEAP)
+		goto out_of_memory;
+	} while (!__atomic_compare_exchange_n(&mem_hdr->brk, &brk, brk + incr, 0,
+					      __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	mem_brk = mem_start_brk + brk + incr;
+	return (void *)(mem_start_brk + brk);
     }
+
+    if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr))
+	goto out_of_memory;
     mem_brk += incr;
     return (void *)old_brk;
+
+ out_of_memory:
+    errno = ENOMEM;
+    fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
+    return (void *)-1;
 }
 
 /*
@@ -81,6 +357,8 @@ void *mem_heap_lo()
  */
 void *mem_heap_hi()
 {
+    if (mem_hdr != NULL)
+	mem_brk = mem_start_brk + mem_hdr->brk;
     return (void *)(mem_brk - 1);
 }
 
@@ -89,6 +367,8 @@ void *mem_heap_hi()
  */
 size_t mem_heapsize() 
 {
+    if (mem_hdr != NULL)
+	mem_brk = mem_start_brk + mem_hdr->brk;
     return (size_t)(mem_brk - mem_start_brk);
 }
 
@@ -9,3 +9,19 @@ void *mem_heap_hi(void);
 size_t mem_heapsize(void);
 size_t mem_pagesize(void);
 
+/* How to back the simulated heap; set before mem_init */
+#define MEM_THP     0x1  /* transparent huge pages, via madvise */
+#define MEM_HUGETLB 0x2  /* explicit huge pages from the hugetlb pool */
+#define MEM_PREFAULT 0x4 /* fault in every page of the heap at mem_init */
+#define MEM_LOCK    0x8  /* and lock them in memory with mlock */
+
+void mem_set_flags(int flags);
+size_t mem_hugepage_bytes(void);
+
+/* Or from a file, which keeps the heap and its brk across runs */
+void mem_set_file(const char *path);
+int mem_sync(void);
+
+/* Or from a shared memory object, to share the heap between processes */
+void mem_set_shm(const char *name);
+
@@ -7,19 +7,80 @@
  * 
  * Explicit free list based malloc package with first fit / next fit placing and real time coalescing.
  *
+ * TLSF 빌드 (make TLSF=1): 크기별 2단계 분리 가용 리스트와 비트맵으로 malloc/free가 O(1).
+ * With make TLSF=1 the free blocks are kept in two-level segregated lists
+ * (TLSF) indexed by bitmaps instead, so malloc and free take constant time.
+ *
+ * SIZE_ARRAY 빌드 (make SIZE_ARRAY=1): 가용 블록의 크기를 빽빽한 배열에 두고 SIMD 비교로 훑는다.
+ * With make SIZE_ARRAY=1 the free block sizes are kept in a dense array
+ * that find_fit scans with SIMD compares instead of chasing the list.
+ *
+ * PERSIST 빌드 (make PERSIST=1): 가용 리스트와 루트를 힙 시작에서의 오프셋으로 저장해 힙 파일에 다시 붙는다.
+ * With make PERSIST=1 the free list links and the roots are heap offsets,
+ * so that mm_init can reattach to the heap in a heap file (mem_set_file)
+ * wherever it is mapped. With THREAD_SAFE the lock lives in the heap too
+ * and is shared between processes, so that processes that map the same
+ * shared memory object (mem_set_shm) can all malloc and free in one heap.
+ *
+ * THREAD_SAFE 빌드 (make THREAD_SAFE=1): 전역 락으로 힙을 보호한다. 기본 빌드는 단일 스레드 전용이다.
+ * With make THREAD_SAFE=1 one global lock protects the heap, so that many
+ * threads (mdriver -T) or processes (--procs) can share it. The default
+ * build is single threaded and pays for no lock.
+ *
+ * REMOTE_FREE 빌드 (make REMOTE_FREE=1, THREAD_SAFE 포함): 다른 스레드의 블록은 락 없이 소유자 큐로 free.
+ * With make REMOTE_FREE=1 (which implies THREAD_SAFE) a thread frees
+ * another thread's block onto the owner's lock-free queue, see below.
+ *
+ * SITE_PROFILE 빌드 (make SITE_PROFILE=1): mm_malloc_site의 호출 위치별 통계.
+ * With make SITE_PROFILE=1 mm_malloc_site charges allocations to their
+ * call sites; otherwise it is plain mm_malloc and free checks no bit.
  */
 
 #define INSERT_LIFO   // LIFO (삭제시 address order)
 #define NEXT_FIT      // NEXT_FIT (삭제시 FIRST_FIT)
 
+#if defined(TLSF) || defined(SIZE_ARRAY)  // 자체 리스트와 fit을 쓴다 (own lists and fit)
+#undef INSERT_LIFO
+#undef NEXT_FIT
+#endif
+#ifdef PERSIST  // 원격 free의 소유자 표와 스택은 프로세스마다 따로다 (they are per process)
+#undef REMOTE_FREE
+#endif
+#if defined(TLSF) && defined(SIZE_ARRAY)
+#error "TLSF and SIZE_ARRAY are two different free lists, pick one"
+#endif
+#if defined(PERSIST) && (defined(TLSF) || defined(SIZE_ARRAY))
+#error "PERSIST keeps only the default free list in the heap"
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <stdint.h>
+
+#ifdef THREAD_SAFE
+#include <pthread.h>
+#endif
+
+#ifdef SIZE_ARRAY
+#include <sys/mman.h>
+#endif
+
+#if defined(SIZE_ARRAY) && (defined(__AVX2__) || defined(__SSE2__))
+#include <immintrin.h>
+#elif defined(SIZE_ARRAY) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(SIZE_ARRAY)
+#warning "SIZE_ARRAY without SSE2, AVX2 or NEON: sa_find scans the sizes in plain C"
+#endif
 
 #include "mm.h"
 #include "memlib.h"
+#include "config.h"
 
 team_t team = {
     "team7",
@@ -35,17 +96,34 @@ team_t team = {
 #define MINIMUM 16      // 헤더, 푸터, PREV, NEXT
 #define CHUNKSIZE (1<<12)     // test case optimized
 #define INITCHUNKSIZE (1<<6)  // test case optimized
+#define HEADROOM_MAX (1<<16)  // realloc 여유분 상한 (cap on realloc headroom)
+
+/* 
+* 페이로드 정렬: config.h 또는 make ALIGN=16|32|64 로 정한다. 블록 크기를 ALIGNMENT의 배수로 맞추면
+* 첫 블록만 정렬해 두면 모든 블록이 정렬된다.
+* payload alignment (config.h, or make ALIGN=16|32|64). Every block size is a multiple of
+* ALIGNMENT, so once the first payload is aligned all of them are.
+*/
+#ifndef ALIGNMENT
 #define ALIGNMENT DSIZE
+#endif
+#if ALIGNMENT < DSIZE || (ALIGNMENT & (ALIGNMENT-1))
+#error "ALIGNMENT must be a power of two, at least DSIZE"
+#endif
 
 /* 유틸 함수 매크로 (util function macro) */
-#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~0x7)
-#define SIZE_T_SIZE (ALIGN(sizeof(size_t)))
+#define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~(ALIGNMENT-1))
+#define MINBLOCK ALIGN(MINIMUM)   // 가장 작은 블록 (smallest block)
 #define MAX(x, y) ((x) > (y) ? (x) : (y)) 
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
 #define PACK(size, alloc) ((size) | (alloc))
 #define GET(p)          (*(unsigned int*)(p))
 #define PUT(p, val)     (*(unsigned int*)(p) = (val))
 #define GET_SIZE(p)     (GET(p) & ~0x7)
 #define GET_ALLOC(p)    (GET(p) & 0x1)
+#define GROWN           0x2             // realloc으로 커진 적 있는 할당 블록 (grown by realloc)
+#define GET_GROWN(p)    (GET(p) & GROWN)
+#define HEADROOM(asize) MIN(ALIGN((asize) / 2), HEADROOM_MAX)  // 다시 커질 블록에 더 얹는 용량
 
 /* 
 * 블록 포인터 bp를 인자로 받아 블록의 헤더와 푸터의 주소를 반환한다 
@@ -64,22 +142,201 @@ team_t team = {
 /* 
 * Free List( 이중 연결리스트 ) 상에서의 이전, 이후 블록의 포인터. 
 * previous, next block in free list (doubly linked list)
+*
+* PERSIST: 포인터 대신 heap_base에서의 오프셋을 적는다. 0은 NULL이다 (0에는 블록이 없다).
+* PERSIST: the words hold offsets from heap_base instead, 0 for NULL
+* (no block starts at offset 0), so the list holds at any mapping address.
+* 오프셋은 GET/PUT으로 4바이트 워드에 쓰므로 size_t 크기와 상관없다.
+* Offsets are 4-byte words read and written with GET and PUT, whatever the
+* size of size_t, so a heap file has one layout.
 */
+#ifdef PERSIST
+_Static_assert(MAX_HEAP <= 0xffffffffUL, "PERSIST heap offsets are 4-byte words");
+
+#define HEAP_OFF(p)     ((p) == NULL ? 0 : (unsigned int)((char*)(p) - heap_base))
+#define HEAP_PTR(off)   ((off) == 0 ? NULL : (void*)(heap_base + (off)))
+#define PREV_FREEP(bp)  HEAP_PTR(GET(bp))
+#define NEXT_FREEP(bp)  HEAP_PTR(GET((char*)(bp) + WSIZE))
+#else
 #define PREV_FREEP(bp)  (*(void**)(bp))  
 #define NEXT_FREEP(bp)  (*(void**)(bp + WSIZE))
+#endif
 
 /*
 * 블록 포인터를 받아서 free list 상의 현재 bp 블록 앞, 뒤를 두번째 인자로 변경
 * set PREV of bp as prev
 * set NEXT of bp as next
 */
+#ifdef PERSIST
+#define SET_PREV(bp, prev) PUT(bp, HEAP_OFF(prev))
+#define SET_NEXT(bp, next) PUT((char*)(bp) + WSIZE, HEAP_OFF(next))
+#else
 #define SET_PREV(bp, prev) (*((void **)(bp)) = prev) 
 #define SET_NEXT(bp, next) (*((void **)(bp + WSIZE)) = next) 
+#endif
+
+/*
+* 멀티스레드 환경에서는 하나의 전역 락으로 힙 전체를 보호한다.
+* protect the whole heap with one global lock (mdriver -T)
+*/
+#ifdef THREAD_SAFE
+static pthread_mutex_t mm_lock = PTHREAD_MUTEX_INITIALIZER;
+#ifdef PERSIST
+/*
+* PERSIST: 락은 힙의 루트에 있는 프로세스 공유 robust 뮤텍스다. mm_init 동안만 mm_lock을 쓴다.
+* PERSIST: the lock is a process-shared robust mutex in the heap's root,
+* mm_lock only guards mm_init itself.
+*/
+static pthread_mutex_t *mm_lockp = &mm_lock;
+static void heap_lock(void);
+#define LOCK()      heap_lock()
+#define UNLOCK()    pthread_mutex_unlock(mm_lockp)
+#define POISONED()  (mm_root->poisoned)   // 힙이 망가졌다, 다시 만들 때까지 쓰지 않는다
+#else
+#define LOCK()      pthread_mutex_lock(&mm_lock)
+#define UNLOCK()    pthread_mutex_unlock(&mm_lock)
+#endif
+#else
+#define LOCK()
+#define UNLOCK()
+#endif
+#ifndef POISONED
+#define POISONED()  0
+#endif
+
+/*
+* 원격 free: 다른 스레드가 할당한 블록을 free 하면 락을 잡지 않고 소유 스레드의
+* lock-free 스택(MPSC)에 넣는다. 소유자는 다음 malloc 때 락을 잡은 김에 스택을 통째로
+* 가져와(exchange) 한꺼번에 free 한다. 스택의 next 포인터는 블록의 페이로드에 쓴다.
+* 블록의 소유자는 페이로드 ALIGNMENT마다 한 바이트인 옆 테이블에 기록한다.
+* remote frees: freeing a block that another thread allocated does not take
+* the lock, it pushes the block onto the owner's lock-free MPSC stack. The
+* owner swaps the whole stack out on its next malloc, while it holds the lock
+* anyway, and frees the batch. The owner of each block is kept in a side
+* table with one byte per ALIGNMENT bytes of heap.
+* 스레드가 끝나면 TLS 소멸자가 번호의 산 스레드 수를 줄인다. 산 스레드가 없는 번호(고아)의
+* 스택은 다음에 malloc 하는 아무 스레드가 비운다.
+* When a thread exits, a TLS destructor takes it off its id's count of
+* live threads. The stack of an id with no live thread left is orphaned,
+* and whichever thread mallocs next drains it.
+*/
+#ifdef REMOTE_FREE
+#ifndef THREAD_SAFE
+#error "REMOTE_FREE needs THREAD_SAFE"
+#endif
+#define MAXTHREADS 256  // 소유자 id는 한 바이트 (thread ids wrap around)
+#define OWNER(bp)   (owner_tab[((char*)(bp) - (char*)mem_heap_lo()) / ALIGNMENT])
+#define REMOTE_NEXT(bp) (*(void**)(bp))
+
+static unsigned char owner_tab[MAX_HEAP / ALIGNMENT];
+static void *remote_head[MAXTHREADS];   // 소유자별 원격 free 스택 (per-owner stacks)
+static int tid_live[MAXTHREADS];        // 번호마다 산 스레드 수 (live threads per id)
+static int orphans = 0;                 // 고아 스택에 블록이 있을 수 있다 (orphaned stacks to drain)
+static int num_threads = 0;
+static __thread int my_tid = -1;
+static pthread_key_t tid_key;
+static pthread_once_t tid_once = PTHREAD_ONCE_INIT;
+
+static int thread_id(void);
+static void tid_key_init(void);
+static void thread_exit(void *arg);
+static int drain_remote(int tid);
+static void drain_orphans(void);
+static int drain_all(void);
+#endif
+
+/*
+* 할당 위치 통계: 표본으로 뽑힌 할당은 WSIZE를 더 받아 블록의 마지막 워드에 사이트 번호를 적고
+* 헤더에 SITED를 켠다. free와 realloc은 이 비트를 보고 사이트에 시간과 바이트를 매긴다.
+* 사이트 표는 열린 주소법 해시이고 칸은 CAS로 차지한다. 카운터는 원자적 덧셈이라 락이 없다.
+* allocation sites: a sampled allocation asks for WSIZE more bytes, puts its
+* site's index in the last word of the block and sets SITED in the header,
+* so that free and realloc can charge the site too. The site table is open
+* addressed, slots are claimed with a CAS and the counters are atomic adds,
+* so recording takes no lock.
+*/
+#ifdef SITE_PROFILE
+#define SITED       0x4                                     // 사이트 번호가 있는 블록 (block carries a site)
+#define SITE_MAX    1024                                    // 사이트 표 칸 수, 2의 거듭제곱
+#define SITEP(bp)   ((unsigned int *)(FTRP(bp) - WSIZE))    // 블록의 마지막 워드 (last word of the block)
+
+typedef struct {
+    unsigned int state;       // 0 빈 칸, 1 채우는 중, 2 사용 중 (empty, being filled, in use)
+    const char *file;         // __FILE__, 번호로 된 사이트면 NULL
+    unsigned int line;        // __LINE__ 또는 사이트 번호 (or the site number)
+    unsigned long count;      // 표본 할당 수 (sampled allocations)
+    unsigned long long bytes; // 요청한 바이트 (bytes requested)
+    long long live;           // 지금 가진 블록 바이트 (block bytes held now)
+    long long peak;           // live의 최댓값
+    unsigned long long ns;    // malloc, realloc, free에 쓴 시간 (time in malloc, realloc, free)
+} site_t;
+
+static site_t site_tab[SITE_MAX];
+static int site_dirty = 0;             // 표에 기록이 있다 (mm_init clears the table)
+static unsigned int site_every = 1;    // 스레드마다 site_every 번에 한 번 기록 (sample rate)
+static __thread unsigned int site_tick;
+
+static site_t *site_lookup(const char *file, unsigned int line);
+static void site_charge(site_t *s, size_t bytes, long long blk, unsigned long long ns);
+static unsigned long long site_ns(void);
+static void site_free(void *bp);
+static void *site_realloc(void *ptr, size_t size);
+#endif
 
 /* free 블록: 이중연결리스트로 관리하며 prev, next 가 있다.
 *  allocated 블록: 헤더와 푸터만 있다.
 */
 
+/*
+* PERSIST: 루트들은 힙 맨 앞의 mm_root_t에 오프셋으로 있다. heap_listp, free_listp, last_bp는
+* 그것을 읽는 매크로가 되고 값은 SET_FREE_LIST, SET_ROVER로 바꾼다. magic은 힙이 다 만들어진
+* 뒤에 적으므로, 만들다 만 힙에는 다시 붙지 않는다.
+* PERSIST: the roots are offsets in an mm_root_t at the very start of the
+* heap. heap_listp, free_listp and last_bp become macros that read it, and
+* SET_FREE_LIST and SET_ROVER change it. The magic is written once the heap
+* is whole, so that mm_init never reattaches to a half-built one.
+* 고정 폭 필드가 먼저 오고, 크기가 ABI마다 다른 뮤텍스는 맨 뒤에 있다. abi에 루트 크기와
+* 포인터 크기를 적어 -m32 빌드와 64비트 빌드가 서로의 힙에 붙지 않게 한다.
+* The fixed-width fields come first and the mutex, whose size depends on
+* the ABI, last. abi records the root's size and the pointer size, so
+* that a -m32 build and a 64-bit build refuse each other's heaps.
+*/
+#ifdef PERSIST
+#define ROOT_MAGIC  0x6d6d7270  // "mmrp"
+
+typedef struct {
+    uint32_t magic;       // ROOT_MAGIC, 힙이 완성되면 (once the heap is whole)
+    uint32_t align;       // ALIGNMENT와 WSIZE가 맞아야 붙는다 (must match to reattach)
+    uint32_t abi;         // ROOT_ABI도 맞아야 붙는다 (and so must ROOT_ABI)
+    uint32_t heap_list;   // heap_listp의 오프셋
+    uint32_t free_list;   // free_listp의 오프셋
+    uint32_t rover;       // last_bp의 오프셋
+    uint32_t user;        // mm_set_root의 오프셋
+#ifdef THREAD_SAFE
+    uint32_t poisoned;    // 락을 쥔 채 죽은 프로세스가 힙을 망가뜨렸다 (a dead lock holder broke the heap)
+    char boot[40];        // 락을 만든 부팅의 boot_id (the boot the lock was made in)
+    pthread_mutex_t lock; // 힙을 쓰는 모든 프로세스의 락 (the lock of every process on the heap)
+#endif
+} mm_root_t;
+
+#define ROOT_ABI    ((uint32_t)(sizeof(mm_root_t) << 8 | sizeof(void *)))
+
+static char *heap_base;      // mem_heap_lo(), 오프셋의 기준 (what offsets count from)
+static mm_root_t *mm_root;   // heap_base에 있다 (lives at heap_base)
+
+#ifdef THREAD_SAFE
+static void root_lock_init(void);
+static const char *boot_id(void);
+static int heap_check(void);
+#endif
+
+#define heap_listp  ((char*)HEAP_PTR(mm_root->heap_list))
+#define free_listp  ((char*)HEAP_PTR(mm_root->free_list))
+#define last_bp     ((char*)HEAP_PTR(mm_root->rover))
+#define SET_HEAP_LIST(p) (mm_root->heap_list = HEAP_OFF(p))
+#define SET_FREE_LIST(p) (mm_root->free_list = HEAP_OFF(p))
+#define SET_ROVER(p)     (mm_root->rover = HEAP_OFF(p))
+#else
 static char *heap_listp = NULL; 
 /*
 묵시적 할당기 : 항상 힙의 프롤로그 헤더와 프롤로그 푸터 사이를 가리키는 정적변수 포인터
@@ -91,6 +348,59 @@ static char *free_listp = NULL; // free list 의 첫 블록을 가리키는 정
 #ifdef NEXT_FIT
     static char *last_bp;
 #endif
+static void *user_root = NULL;  // mm_set_root
+
+#define SET_HEAP_LIST(p) (heap_listp = (p))
+#define SET_FREE_LIST(p) (free_listp = (p))
+#define SET_ROVER(p)     (last_bp = (p))
+#endif
+
+static mm_pool_t *pool_list = NULL;  // 모든 풀 (every pool, for mm_heapstat)
+
+/*
+* TLSF: 1단계는 크기의 최상위 비트(2의 거듭제곱 구간), 2단계는 그 구간을 SL_COUNT 등분한다.
+* 리스트마다 비트 하나가 있어 비어있지 않은 리스트를 비트 연산 두 번으로 찾는다.
+* TLSF: the first level is the size's top bit (a power of two range), the
+* second splits that range into SL_COUNT lists. One bit per list finds the
+* first non-empty list that fits in two bit scans, whatever the heap size.
+*/
+#ifdef TLSF
+#define SL_LOG2   4
+#define SL_COUNT  (1 << SL_LOG2)
+#define FL_COUNT  32
+#define FLS(x)    (31 - __builtin_clz((unsigned int)(x)))  // 최상위 비트 (top set bit)
+#define FFS(x)    (__builtin_ctz(x))                        // 최하위 비트 (lowest set bit)
+
+static char *tlsf_head[FL_COUNT][SL_COUNT];  // NULL로 끝나는 리스트 (NULL terminated)
+static unsigned int fl_bitmap;               // 비어있지 않은 1단계 (non-empty first levels)
+static unsigned int sl_bitmap[FL_COUNT];     // 비어있지 않은 2단계 (non-empty second levels)
+
+static void tlsf_mapping(size_t size, int *fl, int *sl);
+#endif
+
+/*
+* SIZE_ARRAY: 가용 블록마다 배열 칸 하나에 크기와 힙 오프셋을 둔다. find_fit은 리스트의 포인터를
+* 따라가며 헤더를 읽는 대신 크기 배열을 벡터 비교로 여러 칸씩 훑는다. 블록의 칸 번호는
+* 블록의 PREV 자리에 두고, 지울 때는 마지막 칸을 빈 칸으로 옮긴다.
+* SIZE_ARRAY: each free block has a slot in two dense arrays, its size and
+* its offset in the heap. find_fit compares many sizes per instruction
+* instead of following list pointers into headers, two dependent misses
+* per candidate. A block keeps its slot number in its PREV word, and
+* deleting moves the last slot into the hole. The arrays are mapped on the
+* first mm_init and only the pages the slots in use touch take memory.
+*/
+#ifdef SIZE_ARRAY
+#define SA_MAX      (MAX_HEAP / MINBLOCK + 8)   // 가용 블록 수의 상한 + 벡터 하나 (max free blocks + a vector)
+#define SLOT(bp)    (*(unsigned int *)(bp))     // 블록의 칸 번호 (the block's slot)
+#define SA_BLKP(i)  ((char *)mem_heap_lo() + sa_off[i])
+
+static unsigned int *sa_size;         // 가용 블록 크기, SA_MAX 칸 (free block sizes)
+static unsigned int *sa_off;          // 가용 블록의 bp - mem_heap_lo(), SA_MAX 칸
+static unsigned int sa_count;         // 쓰는 칸 수 (slots in use)
+
+static int sa_map(void);
+static int sa_find(unsigned int asize);
+#endif
 
 static void* extend_heap(size_t words);
 static void* coalesce(void* bp);
@@ -98,6 +408,13 @@ static void* find_fit(size_t asize);
 static void* place(void* bp, size_t newsize);
 static void insert_node(void* bp);
 static void delete_node(void *bp);
+static void* malloc_block(size_t size);
+static void free_block(void *bp);
+static void* realloc_block(void *ptr, size_t size);
+static void resize_block(void *bp, size_t csize, size_t keep, unsigned int grown);
+static void free_ptr(void *bp);
+static void *realloc_ptr(void *ptr, size_t size);
+static void reset_state(void);
 
 int mm_init(void);
 void *mm_malloc(size_t size);
@@ -111,54 +428,469 @@ void *mm_realloc(void *ptr, size_t size);
  */
 int mm_init(void)
 {
+    int ret = 0;
+    size_t pad;
+    char *bp;
+
+#if defined(PERSIST) && defined(THREAD_SAFE)
+    mm_lockp = &mm_lock;
+#endif
+    LOCK();
+#ifdef SIZE_ARRAY
+    if (sa_size == NULL && sa_map() < 0) {
+        UNLOCK();
+        return -1;
+    }
+#endif
+#ifdef PERSIST
+    /* 
+     * 힙 파일에 완성된 힙이 있으면 루트만 읽고 다시 붙는다 (O(1))
+     * reattach to a whole heap the heap file already holds: O(1)
+     */
+    heap_base = mem_heap_lo();
+    mm_root = (mm_root_t *)heap_base;
+    if (mem_heapsize() > 0 && mm_root->magic == ROOT_MAGIC) {
+        if (mm_root->align != (ALIGNMENT << 8 | WSIZE) || mm_root->abi != ROOT_ABI)
+            ret = -1;  // 다른 빌드의 힙 (a heap of another build)
+#ifdef THREAD_SAFE
+        else if (mm_root->poisoned)
+            ret = -1;  // 망가진 힙, mem_reset_brk 후 새로 만든다 (broken: reset and make it anew)
+#endif
+        else {
+#ifdef THREAD_SAFE
+            // 지난 부팅에 파일에 남은 락 상태는 뜻이 없다 (a lock left by an earlier boot means nothing)
+            if (strcmp(mm_root->boot, boot_id()) != 0)
+                root_lock_init();
+#endif
+            reset_state();
+            ret = 1;
+        }
+        UNLOCK();
+#ifdef THREAD_SAFE
+        if (ret == 1)
+            mm_lockp = &mm_root->lock;
+#endif
+        return ret;
+    }
+    if (mem_sbrk(ALIGN(sizeof(mm_root_t))) == (void*)-1) {
+        UNLOCK();
+        return -1;
+    }
+    mm_root->magic = 0;
+    mm_root->user = 0;
+#ifdef THREAD_SAFE
+    mm_root->poisoned = 0;
+#endif
+#endif
+    /* 
+     * 첫 가용 블록의 페이로드(6워드 뒤)가 ALIGNMENT에 맞도록 앞을 채운다
+     * pad so that the first block's payload, 6 words in, is aligned 
+     */
+    pad = (ALIGNMENT - ((size_t)mem_heap_hi() + 1 + 6*WSIZE) % ALIGNMENT) % ALIGNMENT;
+
     /* 미사용 패딩, 프롤로그 블록 헤더, 프롤로그 블록 PREV, 프롤로그 블록 NEXT, 프롤로그 블록 푸터,에필로그 푸터 */
-    if ((heap_listp = mem_sbrk(6*WSIZE)) == (void*)-1)
+    if ((bp = mem_sbrk(pad + 6*WSIZE)) == (void*)-1) {
+        UNLOCK();
         return -1;
+    }
+    bp += pad;
 
     // 포인터 위치 지정
-    PUT(heap_listp, 0);                             // unused
-    PUT(heap_listp + (1*WSIZE), PACK(MINIMUM, 1));  // prologue header = '16'
-    PUT(heap_listp + (2*WSIZE), NULL);              // prologue block PREV =  'NULL'
-    PUT(heap_listp + (3*WSIZE), NULL);              // prologue block NEXT =  'NULL'
-    PUT(heap_listp + (4*WSIZE), PACK(MINIMUM, 1));  // prologue footer = '16'
-    PUT(heap_listp + (5*WSIZE), PACK(0, 1));        // epliogue header = '1'
-    free_listp = heap_listp + DSIZE;  // heap_listp (0) + 프롤로그 헤더 + 프롤로그 PREV가 가용블록의 시작점
-    heap_listp = free_listp;
+    PUT(bp, 0);                             // unused
+    PUT(bp + (1*WSIZE), PACK(MINIMUM, 1));  // prologue header = '16'
+    SET_PREV(bp + (2*WSIZE), NULL);         // prologue block PREV =  'NULL'
+    SET_NEXT(bp + (2*WSIZE), NULL);         // prologue block NEXT =  'NULL'
+    PUT(bp + (4*WSIZE), PACK(MINIMUM, 1));  // prologue footer = '16'
+    PUT(bp + (5*WSIZE), PACK(0, 1));        // epliogue header = '1'
+    SET_FREE_LIST(bp + DSIZE);  // bp (0) + 프롤로그 헤더 + 프롤로그 PREV가 가용블록의 시작점
+    SET_HEAP_LIST(bp + DSIZE);
 
 #ifdef NEXT_FIT
-    last_bp = heap_listp;
+    SET_ROVER(heap_listp);
+#endif
+    reset_state();
+#ifndef PERSIST
+    user_root = NULL;
 #endif
     
     // 초기 가용블록 생성 
     if (extend_heap(INITCHUNKSIZE / WSIZE) == NULL) //실패하면 -1 리턴
+        ret = -1;
+#ifdef PERSIST
+    else {
+#ifdef THREAD_SAFE
+        root_lock_init();
+#endif
+        mm_root->align = ALIGNMENT << 8 | WSIZE;
+        mm_root->abi = ROOT_ABI;
+        mm_root->magic = ROOT_MAGIC;  // 이제 힙이 완성됐다 (the heap is whole now)
+    }
+#endif
+    UNLOCK();
+#if defined(PERSIST) && defined(THREAD_SAFE)
+    if (ret == 0)
+        mm_lockp = &mm_root->lock;
+#endif
+    return ret;
+}
+
+#if defined(PERSIST) && defined(THREAD_SAFE)
+/*
+ * heap_lock
+ * - 힙의 락을 잡는다. 락을 쥔 채 죽은 프로세스가 있으면 그 op가 반쯤 된 채로 남았을 수 있으므로
+ *   heap_check로 힙을 검사하고, 망가졌으면 루트에 poisoned를 켠 뒤 락을 되살린다.
+ * - take the heap's lock. If its holder died with it, the op it was in
+ *   may be left half done: check the heap, and poison the root if it is
+ *   broken, before the lock is made consistent again.
+ */
+static void heap_lock(void)
+{
+    if (pthread_mutex_lock(mm_lockp) == EOWNERDEAD) {
+        if (!mm_root->poisoned && heap_check() < 0) {
+            fprintf(stderr, "mm: a process died holding the heap lock and left the heap broken, "
+                    "the heap is poisoned until it is made anew\n");
+            mm_root->poisoned = 1;
+        }
+        pthread_mutex_consistent(mm_lockp);
+    }
+}
+
+/*
+ * heap_check
+ * - 락을 잡은 상태에서 힙의 구조를 검사한다. 모든 블록의 크기, 헤더와 푸터, 에필로그,
+ *   그리고 가용 리스트의 링크와 블록 수를 본다. 이상이 없으면 0, 있으면 -1.
+ * - with the lock held, check the heap's structure: every block's size,
+ *   header and footer, the epilogue at the break, the rover on a block,
+ *   and the free list's links against the free blocks the walk found.
+ *   Returns 0 if the heap is whole, -1 if not.
+ */
+static int heap_check(void)
+{
+    char *bp, *prev, *lo = heap_base, *hi = (char *)mem_heap_hi() + 1;
+    size_t size, nfree = 0, nlisted = 0;
+    int rover_ok = 0;
+
+    if (heap_listp <= lo || heap_listp >= hi || GET(HDRP(heap_listp)) != PACK(MINIMUM, 1))
+        return -1;
+    for (bp = SUCC_BLKP(heap_listp); ; bp = SUCC_BLKP(bp)) {
+        if (bp > hi)
+            return -1;
+#ifdef NEXT_FIT
+        if (bp == last_bp)
+            rover_ok = 1;
+#endif
+        if ((size = GET_SIZE(HDRP(bp))) == 0)
+            break;  // 에필로그 (the epilogue)
+        if (size < MINBLOCK || size % ALIGNMENT != 0 || bp + size > hi
+            || GET_SIZE(FTRP(bp)) != size || GET_ALLOC(FTRP(bp)) != GET_ALLOC(HDRP(bp)))
+            return -1;
+        if (!GET_ALLOC(HDRP(bp)))
+            nfree++;
+    }
+    if (bp != hi || !GET_ALLOC(HDRP(bp)))
+        return -1;
+#ifdef NEXT_FIT
+    if (last_bp == heap_listp)
+        rover_ok = 1;
+#else
+    rover_ok = 1;
+#endif
+    if (!rover_ok)
+        return -1;
+
+    // 가용 리스트는 프롤로그에서 끝난다 (the free list ends at the prologue)
+    for (prev = NULL, bp = free_listp; bp != heap_listp; prev = bp, bp = NEXT_FREEP(bp)) {
+        if (bp == NULL || bp <= lo || bp >= hi || (size_t)bp % ALIGNMENT != 0
+            || GET_ALLOC(HDRP(bp)) || PREV_FREEP(bp) != prev || ++nlisted > nfree)
+            return -1;
+    }
+    if (nlisted != nfree || PREV_FREEP(heap_listp) != prev)
         return -1;
     return 0;
 }
 
 /*
- * mm_malloc 
+ * root_lock_init
+ * - 루트의 락을 프로세스 공유 robust 뮤텍스로 새로 만든다
+ * - make the root's lock afresh, process-shared and robust
+ */
+static void root_lock_init(void)
+{
+    pthread_mutexattr_t attr;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&mm_root->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    strncpy(mm_root->boot, boot_id(), sizeof(mm_root->boot) - 1);
+    mm_root->boot[sizeof(mm_root->boot) - 1] = '\0';
+}
+
+/*
+ * boot_id
+ * - 이번 부팅의 id, 없으면 "" (this boot's id, or "" if there is none)
+ */
+static const char *boot_id(void)
+{
+    static char id[40];
+    FILE *fp;
+
+    if (id[0] == '\0' && (fp = fopen("/proc/sys/kernel/random/boot_id", "r")) != NULL) {
+        if (fgets(id, sizeof(id), fp) == NULL)
+            id[0] = '\0';
+        id[strcspn(id, "\n")] = '\0';
+        fclose(fp);
+    }
+    return id;
+}
+#endif
+
+/*
+ * reset_state
+ * - 힙 밖에 있는 상태를 비운다. 새 힙에서도, 다시 붙은 힙에서도 이전 것은 쓸 수 없다.
+ * - clear the state kept outside the heap, which is no good for a new heap
+ *   nor for a reattached one
+ */
+static void reset_state(void)
+{
+#ifdef TLSF
+    memset(tlsf_head, 0, sizeof(tlsf_head));
+    memset(sl_bitmap, 0, sizeof(sl_bitmap));
+    fl_bitmap = 0;
+#endif
+#ifdef REMOTE_FREE
+    memset(remote_head, 0, sizeof(remote_head));  // 이전 힙의 블록은 버린다
+#endif
+    pool_list = NULL;  // 이전 힙의 풀도 버린다 (pools die with the heap)
+#ifdef SITE_PROFILE
+    if (site_dirty) {  // 이전 힙의 블록 통계도 버린다
+        memset(site_tab, 0, sizeof(site_tab));
+        site_dirty = 0;
+    }
+#endif
+#ifdef SIZE_ARRAY
+    sa_count = 0;
+#endif
+}
+
+/*
+ * mm_malloc, mm_free, mm_realloc
+ * - 락을 잡고 실제 작업은 락 없는 내부 함수에 맡긴다 (realloc 내부에서 재진입하지 않도록)
+ * - take the lock and hand over to the unlocked internal versions
+ */
+void *mm_malloc(size_t size)
+{
+    void *bp;
+#ifdef REMOTE_FREE
+    int tid = thread_id();
+#endif
+
+    LOCK();
+#ifdef REMOTE_FREE
+    drain_remote(tid);
+    if (__atomic_load_n(&orphans, __ATOMIC_RELAXED))
+        drain_orphans();
+#endif
+    bp = malloc_block(size);
+#ifdef REMOTE_FREE
+    if (bp != NULL)
+        OWNER(bp) = tid;
+#endif
+    UNLOCK();
+    return bp;
+}
+
+void mm_free(void *bp)
+{
+#ifdef SITE_PROFILE
+    if (GET(HDRP(bp)) & SITED) {
+        site_free(bp);
+        return;
+    }
+#endif
+    free_ptr(bp);
+}
+
+/*
+ * free_ptr
+ * - 사이트 기록 없이 free 한다 (mm_free without the site accounting)
+ */
+static void free_ptr(void *bp)
+{
+#ifdef REMOTE_FREE
+    int owner = OWNER(bp);
+    void *head;
+
+    // 남의 블록: 소유자 스택에 CAS로 push (another thread's block: push it)
+    if (owner != thread_id()) {
+        head = __atomic_load_n(&remote_head[owner], __ATOMIC_RELAXED);
+        do {
+            REMOTE_NEXT(bp) = head;
+        } while (!__atomic_compare_exchange_n(&remote_head[owner], &head, bp, 1,
+                                              __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+        // 소유자가 이미 끝났으면 다른 스레드가 비우게 한다 (owner gone: have someone drain it)
+        if (__atomic_load_n(&tid_live[owner], __ATOMIC_SEQ_CST) == 0)
+            __atomic_store_n(&orphans, 1, __ATOMIC_RELAXED);
+        return;
+    }
+#endif
+    LOCK();
+    free_block(bp);
+    UNLOCK();
+}
+
+void *mm_realloc(void *ptr, size_t size)
+{
+#ifdef SITE_PROFILE
+    if (ptr != NULL && (GET(HDRP(ptr)) & SITED))
+        return site_realloc(ptr, size);
+#endif
+    return realloc_ptr(ptr, size);
+}
+
+/*
+ * realloc_ptr
+ * - 사이트 기록 없이 realloc 한다 (mm_realloc without the site accounting)
+ */
+static void *realloc_ptr(void *ptr, size_t size)
+{
+    void *new_ptr;
+#ifdef REMOTE_FREE
+    int tid = thread_id();
+#endif
+
+    LOCK();
+    new_ptr = realloc_block(ptr, size);
+#ifdef REMOTE_FREE
+    if (new_ptr != NULL)
+        OWNER(new_ptr) = tid;
+#endif
+    UNLOCK();
+    return new_ptr;
+}
+
+#ifdef REMOTE_FREE
+/*
+ * thread_id
+ * - 처음 부르는 스레드에 작은 번호를 붙인다. MAXTHREADS를 넘으면 번호를 나눠 쓰는데,
+ *   스택을 exchange로 통째로 가져가므로 여러 스레드가 비워도 안전하다.
+ * - give each thread a small id on first use. Past MAXTHREADS ids are
+ *   shared, which is safe since a stack is always taken whole by exchange.
+ */
+static int thread_id(void)
+{
+    if (my_tid < 0) {
+        pthread_once(&tid_once, tid_key_init);
+        my_tid = __atomic_fetch_add(&num_threads, 1, __ATOMIC_RELAXED) % MAXTHREADS;
+        __atomic_fetch_add(&tid_live[my_tid], 1, __ATOMIC_SEQ_CST);
+        pthread_setspecific(tid_key, &tid_live[my_tid]);  // 끝날 때 thread_exit (on exit)
+    }
+    return my_tid;
+}
+
+static void tid_key_init(void)
+{
+    pthread_key_create(&tid_key, thread_exit);
+}
+
+/*
+ * thread_exit(arg)
+ * - 끝나는 스레드를 번호의 산 스레드 수에서 뺀다. 마지막이었으면 스택은 고아가 된다.
+ * - take an exiting thread off its id's live count. If it was the last,
+ *   its stack is orphaned: whatever is on it, or is pushed later, gets
+ *   drained by the next thread that mallocs.
+ */
+static void thread_exit(void *arg)
+{
+    if (__atomic_sub_fetch((int *)arg, 1, __ATOMIC_SEQ_CST) == 0)
+        __atomic_store_n(&orphans, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * drain_remote(tid)
+ * - 락을 잡은 상태에서 tid의 원격 free 스택을 비우고 free 한 블록 수를 리턴한다
+ * - with the lock held, free every block on tid's remote free stack and
+ *   return how many there were
+ */
+static int drain_remote(int tid)
+{
+    void *bp, *next;
+    int n = 0;
+
+    if (__atomic_load_n(&remote_head[tid], __ATOMIC_RELAXED) == NULL)
+        return 0;
+    bp = __atomic_exchange_n(&remote_head[tid], NULL, __ATOMIC_ACQUIRE);
+    for (; bp != NULL; bp = next, n++) {
+        next = REMOTE_NEXT(bp);
+        free_block(bp);
+    }
+    return n;
+}
+
+/*
+ * drain_orphans
+ * - 락을 잡은 상태에서 산 스레드가 없는 번호의 스택을 모두 비운다
+ * - with the lock held, drain the stacks of every id with no live thread
+ */
+static void drain_orphans(void)
+{
+    int tid;
+
+    __atomic_store_n(&orphans, 0, __ATOMIC_SEQ_CST);
+    for (tid = 0; tid < MAXTHREADS; tid++)
+        if (__atomic_load_n(&tid_live[tid], __ATOMIC_SEQ_CST) == 0)
+            drain_remote(tid);
+}
+
+/*
+ * drain_all
+ * - 락을 잡은 상태에서 모든 스택을 비운다. 할 일을 마친 스레드는 malloc 하지 않으므로
+ *   그 스택은 힙을 늘리기 전과 힙을 셀 때 비운다.
+ * - with the lock held, drain every stack: a thread done allocating
+ *   never drains its own, so this is done before the heap grows and
+ *   before it is counted. Returns the number of blocks freed.
+ */
+static int drain_all(void)
+{
+    int tid, n = 0;
+
+    for (tid = 0; tid < MAXTHREADS; tid++)
+        n += drain_remote(tid);
+    return n;
+}
+#endif
+
+/*
+ * malloc_block 
  * - 요청받은 사이즈에 맞는 블록을 (find_fit으로 찾아) 할당한 후 해당 블록의 포인터를 리턴한다
  * - allocate new block and return its pointer
  */
-void *mm_malloc(size_t size)
+static void *malloc_block(size_t size)
 {
     size_t asize;       // 새로 계산할 사이즈
     size_t extendsize;  // 힙 영역에서 늘려줄 사이즈
     char* bp;
 
-    // 가짜 요청(spurious request) 처리
-    if (size == 0)
+    // 가짜 요청(spurious request)이나 망가진 힙 처리 (or a poisoned heap)
+    if (size == 0 || POISONED())
         return NULL;
 
-    // 요청 사이즈에 header와 footer를 위한 double words 공간(SIZE_T_SIZE)을 추가한 후 align해준다.
+    // 요청 사이즈에 header와 footer를 위한 double words 공간(DSIZE)을 추가한 후 align해준다.
     // free 블록에는 prev, next 가 있지만 allocated 블록은 이중연결리스트로 관리되지 않으므로 헤더와 푸터공간만 만들어준다.
-    asize = ALIGN(size + SIZE_T_SIZE);  
+    // (ALIGNMENT가 커도 오버헤드는 DSIZE뿐: overhead stays DSIZE whatever the alignment)
+    asize = MAX(ALIGN(size + DSIZE), MINBLOCK);  
 
     // 할당할 가용 리스트를 찾는다.
     if ((bp = find_fit(asize)) != NULL){  
         bp = place(bp, asize);  // place에서는 필요한 공간만 분할해서 써준다.
         return bp;
     }
+#ifdef REMOTE_FREE
+    // 힙을 늘리기 전에 다른 스레드에 쌓인 free를 받는다 (take the queued frees before growing)
+    if (drain_all() > 0 && (bp = find_fit(asize)) != NULL)
+        return place(bp, asize);
+#endif
 
     extendsize = MAX(asize, CHUNKSIZE);  // 둘 중 더 큰 값으로 사이즈를 정한다.
     if ((bp = extend_heap(extendsize / WSIZE)) == NULL) 
@@ -173,23 +905,59 @@ void *mm_malloc(size_t size)
  * - find an adequate block pointer for requested size  
  */
 static void* find_fit(size_t asize){
-#ifdef NEXT_FIT
+#if defined(TLSF)
+    /* Good fit: 요청을 다음 2단계 경계로 올리면 찾은 리스트의 어떤 블록도 들어간다 */
+    /* round up to the next list boundary, so any block of the list found fits */
+    int fl, sl;
+    unsigned int map;
+    char *bp;
+
+    tlsf_mapping(asize + (1U << (FLS(asize) - SL_LOG2)) - 1, &fl, &sl);
+
+    map = sl_bitmap[fl] & (~0U << sl);
+    if (map == 0) {
+        // 더 큰 1단계에서 찾는다 (try the larger first levels)
+        map = (fl + 1 < FL_COUNT) ? fl_bitmap & (~0U << (fl + 1)) : 0;
+        if (map == 0) {
+            /* 
+             * 힙을 늘리기 전에 asize 자신의 리스트 첫 블록만 본다 (여전히 O(1))
+             * before growing the heap, try the head of asize's own list
+             * (still O(1)): it may hold a block that is just big enough
+             */
+            tlsf_mapping(asize, &fl, &sl);
+            bp = tlsf_head[fl][sl];
+            return (bp != NULL && GET_SIZE(HDRP(bp)) >= asize) ? bp : NULL;
+        }
+        fl = FFS(map);
+        map = sl_bitmap[fl];
+    }
+    sl = FFS(map);
+    return tlsf_head[fl][sl];
+#elif defined(SIZE_ARRAY)
+    /* 크기 배열에서 asize 이상인 첫 칸 (first slot of the size array that fits) */
+    int i = sa_find(asize);
+
+    return (i < 0) ? NULL : SA_BLKP(i);
+#elif defined(NEXT_FIT)
     /* Next-fit */
-    char *old_bp = last_bp;
+    char *bp, *old_bp = last_bp;
 
-    /* 초기화는 보통 평가문에서 참조할 변수가 없을까봐 넣어주는데, 만약에 전역으로 선언해둔 게 있다면 평가문에서 그걸 참조할 것이므로 첫번째부분을 생략하고 세미콜론만 넣어주면 된다.*/
-    
     /* last_bp(현재 힙 마지막)부터 힙 끝까지 서치한다 */
-    for ( ; GET_SIZE(HDRP(last_bp)) > 0; last_bp = SUCC_BLKP(last_bp))
-	if (!GET_ALLOC(HDRP(last_bp)) && (asize <= GET_SIZE(HDRP(last_bp))))
-	    return last_bp;
+    for (bp = old_bp; GET_SIZE(HDRP(bp)) > 0; bp = SUCC_BLKP(bp))
+	if (!GET_ALLOC(HDRP(bp)) && (asize <= GET_SIZE(HDRP(bp))))
+	    goto found;
 
     /* NEXT FIT SEARCH가 실패하면 다시 힙 앞부터 기존 로버 앞까지 탐색한다 */
-    for (last_bp = heap_listp; last_bp < old_bp; last_bp = SUCC_BLKP(last_bp))
-	if (!GET_ALLOC(HDRP(last_bp)) && (asize <= GET_SIZE(HDRP(last_bp))))
-	    return last_bp;  // 로버는 마지막으로 탐색한 블록의 포인터이다. (last bp)
+    for (bp = heap_listp; bp < old_bp; bp = SUCC_BLKP(bp))
+	if (!GET_ALLOC(HDRP(bp)) && (asize <= GET_SIZE(HDRP(bp))))
+	    goto found;
 
+    SET_ROVER(bp);
     return NULL;  /* no fit found */
+
+ found:
+    SET_ROVER(bp);  // 로버는 마지막으로 탐색한 블록의 포인터이다. (last bp)
+    return bp;
 #else
     /* First-fit */
     void* bp;
@@ -218,7 +986,7 @@ static void *place(void* bp, size_t asize){
     delete_node(bp);
 
     // 분할할 수 없어 바로 할당
-    if ((csize - asize) < (2 * DSIZE)) {
+    if ((csize - asize) < MINBLOCK) {
         PUT(HDRP(bp), PACK(csize, 1));
         PUT(FTRP(bp), PACK(csize, 1));
         return bp;
@@ -274,8 +1042,9 @@ static void* extend_heap(size_t words){ // 워드 단위로 받는다.
     char* bp;
     size_t size;
     
-    // 더블워드 정렬. 필요한 바이트를 8의 배수(2words)로 맞춰서 (1word * 2 = 2words. 1word = 4byte.) 할당받는다.
-    size = (words % 2) ? (words + 1) * WSIZE : (words) * WSIZE; 
+    // 필요한 바이트를 ALIGNMENT의 배수로 맞춰서 할당받는다. (기본값은 더블워드, 8의 배수)
+    // round up to a multiple of ALIGNMENT (a double word by default) 
+    size = ALIGN(words * WSIZE); 
     if ((long)(bp = mem_sbrk(size)) == -1) // 새 메모리의 첫 부분을 bp로 둔다. 
         return NULL;
     
@@ -334,20 +1103,24 @@ static void* coalesce(void* bp){
 
 #ifdef NEXT_FIT
     if ((last_bp > (char *)bp) && (last_bp < (char *)SUCC_BLKP(bp))) 
-    last_bp = bp;
+    SET_ROVER(bp);
 #endif
     return bp;
 }
 
 /*
- * mm_free 
+ * free_block 
  * - 할당되었던 블록을 프리하고 아무것도 반환하지 않는다
  * - Free a block and returns nothing
  */
-void mm_free(void *bp)
+static void free_block(void *bp)
 {
+    size_t size;
+
+    if (POISONED())  // 망가진 힙은 건드리지 않는다 (leave a poisoned heap alone)
+        return;
     // 해당 블록의 size를 알아내 header와 footer의 정보를 수정한다
-    size_t size = GET_SIZE(HDRP(bp));
+    size = GET_SIZE(HDRP(bp));
 
     // header와 footer를 설정
     PUT(HDRP(bp), PACK(size, 0));
@@ -363,12 +1136,31 @@ void mm_free(void *bp)
  * - put newly freed block into the free list
  */
 void insert_node(void* bp){
-#ifdef INSERT_LIFO    
+#if defined(TLSF)
+    /* 크기에 맞는 리스트의 앞에 넣고 비트를 켠다 (push onto its list, set its bits) */
+    int fl, sl;
+    char *head;
+
+    tlsf_mapping(GET_SIZE(HDRP(bp)), &fl, &sl);
+    head = tlsf_head[fl][sl];
+    SET_PREV(bp, NULL);
+    SET_NEXT(bp, head);
+    if (head != NULL)
+        SET_PREV(head, bp);
+    tlsf_head[fl][sl] = bp;
+    fl_bitmap |= 1U << fl;
+    sl_bitmap[fl] |= 1U << sl;
+#elif defined(SIZE_ARRAY)
+    /* 마지막 칸 뒤에 붙인다 (append a slot) */
+    sa_size[sa_count] = GET_SIZE(HDRP(bp));
+    sa_off[sa_count] = (char *)bp - (char *)mem_heap_lo();
+    SLOT(bp) = sa_count++;
+#elif defined(INSERT_LIFO)
     /* LIFO */
-    NEXT_FREEP(bp) = free_listp;
-    PREV_FREEP(bp) = NULL;
-    PREV_FREEP(free_listp) = bp;
-    free_listp = bp;
+    SET_NEXT(bp, free_listp);
+    SET_PREV(bp, NULL);
+    SET_PREV(free_listp, bp);
+    SET_FREE_LIST(bp);
 #else
     /* address order */
     void *curr = free_listp;
@@ -385,7 +1177,7 @@ void insert_node(void* bp){
     if (prev != NULL) {
         SET_NEXT(prev, bp);
     } else { 
-        free_listp = bp;    /* Insert bp before current free list head */
+        SET_FREE_LIST(bp);  /* Insert bp before current free list head */
     }
     if (saved != NULL) {
         SET_PREV(saved, bp);
@@ -394,99 +1186,977 @@ void insert_node(void* bp){
 }
 
 /*
- * mm_realloc 
+ * realloc_block 
  * - malloc되어있는 포인터에 새로운 사이즈만큼 재할당한다(새 포인터의 영역이 줄어들거나 늘어날 수 있고 포인터가 변경될 수 있다)
- * - reallocate new size of block to the old pointer or just copy memory into new pointer
+ * - 두 번째로 커지는 블록부터는 HEADROOM만큼 더 주어 다음 realloc을 제자리에서 받는다.
+ *   여유분은 이미 있는 가용 공간에서만 얻고 힙을 늘려서 얻지는 않으며, 줄어들면 돌려준다.
+ *   힙이 모자랄 때는 돌려받지 않는다. 블록은 마지막 요청 크기를 적어두지 않으므로
+ *   여유분과 데이터를 가를 수 없다.
+ * - reallocate new size of block to the old pointer or just copy memory into new pointer.
+ *   A block that grows a second time gets HEADROOM extra bytes so that the next
+ *   reallocs land in place. The headroom only ever comes from free space the heap
+ *   already has, never from growing the heap, and a shrink gives it back.
+ *   Memory pressure does not: a block keeps no record of its last request, so
+ *   malloc_block cannot tell its headroom from its data before extend_heap.
+ *   HEADROOM_MAX and the half-size cap bound what that holds back.
  */
-void *mm_realloc(void *ptr, size_t size)
+static void *realloc_block(void *ptr, size_t size)
 {
-    void *new_ptr = ptr;    /* Pointer to be returned */
-    size_t new_size = size; /* Size of new block */
-    int remainder;          /* Adequacy of block sizes */
-    int extendsize;         /* Size of heap extension */
+    void *new_ptr;
+    char *next, *after;
+    size_t asize, oldsize, csize, room;
+    unsigned int grown;
+
+    if (ptr == NULL || POISONED())
+        return malloc_block(size);
 
     // Ignore size 0 cases
     if (size == 0) {
-        mm_free(ptr);
+        free_block(ptr);
         return NULL;
     }
 
     // Align block size
-    if (new_size <= DSIZE) {
-        new_size = 2 * DSIZE;
-    } else {
-        new_size = ALIGN(size+DSIZE);
+    asize = MAX(ALIGN(size+DSIZE), MINBLOCK);
+    oldsize = GET_SIZE(HDRP(ptr));
+    grown = GET_GROWN(HDRP(ptr));
+    room = grown ? HEADROOM(asize) : 0;
+
+    /* 용량 안이면 그대로, 줄어들면 꼬리를 돌려준다 ( fits: keep the headroom, or give back the tail on a shrink ) */
+    if (asize <= oldsize) {
+        if (oldsize > asize + room)
+            resize_block(ptr, oldsize, asize, 0);
+        return ptr;
     }
 
-    remainder = GET_SIZE(HDRP(ptr)) + GET_SIZE(HDRP(SUCC_BLKP(ptr))) - new_size;
+    /* 마지막 블록이면 모자란 만큼만 힙을 늘린다 ( last block: grow the heap by exactly what is missing ) */
+    next = after = SUCC_BLKP(ptr);
+    csize = oldsize;
+    if (!GET_ALLOC(HDRP(next))) {
+        csize += GET_SIZE(HDRP(next));
+        after = SUCC_BLKP(next);
+    }
+    if (csize < asize && GET_SIZE(HDRP(after)) == 0) {
+        if (extend_heap(MAX(asize - csize, MINBLOCK) / WSIZE) == NULL)  // 가용 블록은 MINBLOCK 이상
+            return NULL;
+        csize = oldsize + GET_SIZE(HDRP(next));  // 새 공간은 next와 합쳐졌다 (coalesced into next)
+        room = 0;
+    }
 
-#ifdef NEXT_FIT   
-    /* 다음 블록이 에필로그 블록 ( if SUCCESSOR is epilogue ) */
-    if  (!GET_SIZE(HDRP(SUCC_BLKP(ptr)))) {
-        remainder = GET_SIZE(HDRP(ptr)) + GET_SIZE(HDRP(SUCC_BLKP(ptr))) - new_size;
-        if (remainder < 0) {
-            // 추가 공간 필요
-            extendsize = MAX(-remainder, CHUNKSIZE);
-            if (extend_heap(extendsize) == NULL)
-                return NULL;
-            remainder += extendsize;
-        }
-        new_ptr = mm_malloc(new_size - DSIZE);  
-        memcpy(new_ptr, ptr, size); 
-        mm_free(ptr);
-        return new_ptr;
-    }
-#endif
-    /* 다음 블록이 free 임 */
-    if (!GET_ALLOC(HDRP(SUCC_BLKP(ptr)))) {
-        if (remainder < 0) {
-            // 추가 공간 필요
-            extendsize = MAX(-remainder, CHUNKSIZE);
-            if (extend_heap(extendsize) == NULL)
-                return NULL;
-            remainder += extendsize;
-        } 
-#ifdef NEXT_FIT        
-        if (remainder >= 24) {
-            delete_node(SUCC_BLKP(ptr));
-            PUT(HDRP(ptr), PACK(new_size, 1)); 
-            PUT(FTRP(ptr), PACK(new_size, 1)); 
-            PUT(HDRP(SUCC_BLKP(ptr)), PACK(remainder, 0)); 
-            PUT(FTRP(SUCC_BLKP(ptr)), PACK(remainder, 0)); 
-            insert_node(SUCC_BLKP(ptr));
-            return ptr;
-        } 
-#endif
-        delete_node(SUCC_BLKP(ptr));   // 스플릿된 채 가용리스트에 들어있는 next는 삭제
-        
-        // Do not split block
-        PUT(HDRP(ptr), PACK(new_size + remainder, 1)); // (ptr + next) 사이즈만큼 place!
-        PUT(FTRP(ptr), PACK(new_size + remainder, 1)); 
-    } else {
-        new_ptr = mm_malloc(new_size - DSIZE);  
-        memcpy(new_ptr, ptr, size); 
-        mm_free(ptr);
+    /* 다음 가용 블록을 흡수한다 ( absorb the free successor ) */
+    if (csize >= asize) {
+        delete_node(next);
+#ifdef NEXT_FIT
+        if (last_bp == next)
+            SET_ROVER(ptr);
+#endif
+        resize_block(ptr, csize, MIN(asize + room, csize), GROWN);
+        return ptr;
     }
 
-    // Return the reallocated block 
+    /* 옮긴다. 여유분은 맞는 가용 블록이 있을 때만 ( move; with headroom only if a free block already fits it ) */
+    if (room && (new_ptr = find_fit(asize + room)) != NULL)
+        new_ptr = place(new_ptr, asize + room);
+    else if ((new_ptr = malloc_block(size)) == NULL)
+        return NULL;
+    memcpy(new_ptr, ptr, oldsize - DSIZE);
+    free_block(ptr);
+    PUT(HDRP(new_ptr), GET(HDRP(new_ptr)) | GROWN);
+    PUT(FTRP(new_ptr), GET(FTRP(new_ptr)) | GROWN);
     return new_ptr;
 }
 
 /*
- * delete_node(bp) 
- * - 할당되거나 연결되는 가용 블록을 free list에서 없앤다
- * - remove pointed block from the free list
+ * resize_block(bp, csize, keep, grown)
+ * - bp를 csize 바이트 할당 블록으로 두되, keep 뒤로 MINBLOCK 이상 남으면 잘라서 가용으로 돌린다
+ * - make bp an allocated block of csize bytes, splitting off and freeing
+ *   what lies past keep if that is a block's worth
  */
-void delete_node(void *bp){
-    void *next = (void *) NEXT_FREEP(bp);
-    void *prev = (void *) PREV_FREEP(bp);
-    if (prev == NULL) { /* Start of the list */
-        free_listp = next;
-    } else {
-        SET_NEXT(prev, next);
+static void resize_block(void *bp, size_t csize, size_t keep, unsigned int grown)
+{
+    if (csize - keep < MINBLOCK)
+        keep = csize;
+    PUT(HDRP(bp), PACK(keep, 1 | grown));
+    PUT(FTRP(bp), PACK(keep, 1 | grown));
+    if (keep < csize) {
+        PUT(HDRP(SUCC_BLKP(bp)), PACK(csize - keep, 0));
+        PUT(FTRP(SUCC_BLKP(bp)), PACK(csize - keep, 0));
+        coalesce(SUCC_BLKP(bp));
+    }
+}
+
+/*
+* 리전(아레나): 힙에서 청크 단위로 블록을 받아 그 안에서 포인터만 밀어 할당한다. 객체는 하나씩
+* free 하지 않는다. reset은 보통 청크를 다음 요청을 위해 남겨두고(spare) 큰 객체의 전용 청크만
+* 힙에 돌려준다. destroy는 모든 청크를 돌려준다. 객체 수와 상관없이 청크마다 coalesce 한 번이다.
+* 리전 헤더는 첫 청크에 들어 있다. 리전 하나는 한 스레드가 쓴다 (청크를 받고 돌려줄 때만 락).
+* regions (arenas): take blocks from the heap a chunk at a time and hand
+* out objects by bumping a pointer. Objects are never freed one by one.
+* Reset keeps the usual chunks as spares for the next round and gives
+* back only the chunks of big objects, so a region that is reset between
+* requests stops touching the heap once it has grown to its working set;
+* destroy gives back every chunk. Either way it is one coalesce per
+* chunk, however many objects were in it. The region header lives in the
+* first chunk. A region is used by one thread at a time; only getting
+* and returning chunks takes the heap lock.
+*/
+#define REGION_CHUNK (1<<12)                        // 보통 청크의 페이로드 (usual chunk payload)
+#define REGION_BIG   (REGION_CHUNK / 4)             // 이보다 큰 객체는 전용 청크 (own chunk above this)
+#define CHUNK_HDR    ALIGN(sizeof(region_chunk_t))  // 청크 맨 앞의 next 포인터
+#define REGION_HDR   ALIGN(sizeof(mm_region_t))
+
+typedef struct region_chunk {
+    struct region_chunk *next;  // 같은 리스트의 다음 청크 (next on the same list)
+} region_chunk_t;
+
+struct mm_region {
+    char *cur;                  // 현재 청크의 빈 곳 (bump pointer)
+    char *end;                  // 현재 청크의 끝
+    region_chunk_t *chunks;     // 쓰는 보통 청크, 최근 것부터. 첫 청크가 맨 끝 (first chunk last)
+    region_chunk_t *big;        // 큰 객체의 전용 청크 (one per big object)
+    region_chunk_t *spare;      // reset이 남긴 보통 청크 (usual chunks kept by reset)
+};
+
+/* 첫 청크: 리전 헤더 바로 앞 (the chunk that holds the header) */
+#define FIRST_CHUNK(r) ((region_chunk_t *)((char *)(r) - CHUNK_HDR))
+
+static void free_chunks(region_chunk_t *c);
+
+/*
+ * mm_region_create
+ * - 첫 청크를 받아 그 안에 리전 헤더를 만든다
+ * - make a region, with its header at the start of its first chunk
+ */
+mm_region_t *mm_region_create(void)
+{
+    region_chunk_t *c;
+    mm_region_t *r;
+
+    LOCK();
+    c = malloc_block(REGION_CHUNK);
+    UNLOCK();
+    if (c == NULL)
+        return NULL;
+    c->next = NULL;
+    r = (mm_region_t *)((char *)c + CHUNK_HDR);
+    r->chunks = c;
+    r->big = r->spare = NULL;
+    r->cur = (char *)r + REGION_HDR;
+    r->end = (char *)c + REGION_CHUNK;
+    return r;
+}
+
+/*
+ * mm_region_alloc(r, size)
+ * - 현재 청크에 자리가 있으면 포인터만 민다. 없으면 남겨둔 청크나 새 청크로 넘어간다.
+ *   큰 객체는 전용 청크를 받고 현재 청크를 계속 쓴다.
+ * - bump the pointer if the object fits in the current chunk. Otherwise
+ *   move on to a spare chunk or a new one; a big object gets a chunk of
+ *   its own and the current chunk stays in use.
+ */
+void *mm_region_alloc(mm_region_t *r, size_t size)
+{
+    region_chunk_t *c;
+    char *p;
+
+    if (size == 0)
+        return NULL;
+    size = ALIGN(size);
+    if (size <= (size_t)(r->end - r->cur)) {
+        p = r->cur;
+        r->cur += size;
+        return p;
+    }
+
+    if (size > REGION_BIG) {
+        LOCK();
+        c = malloc_block(CHUNK_HDR + size);
+        UNLOCK();
+        if (c == NULL)
+            return NULL;
+        c->next = r->big;
+        r->big = c;
+        return (char *)c + CHUNK_HDR;
+    }
+
+    if ((c = r->spare) != NULL)
+        r->spare = c->next;
+    else {
+        LOCK();
+        c = malloc_block(REGION_CHUNK);
+        UNLOCK();
+        if (c == NULL)
+            return NULL;
+    }
+    c->next = r->chunks;
+    r->chunks = c;
+    p = (char *)c + CHUNK_HDR;
+    r->cur = p + size;
+    r->end = (char *)c + REGION_CHUNK;
+    return p;
+}
+
+/*
+ * mm_region_reset(r)
+ * - 리전을 비운다. 보통 청크는 spare로 옮기고 전용 청크만 힙에 돌려준다. O(청크 수).
+ * - empty the region in O(chunks): the usual chunks but the first become
+ *   spares and the big objects' chunks go back to the heap. Every object
+ *   of the region is gone.
+ */
+void mm_region_reset(mm_region_t *r)
+{
+    region_chunk_t *c, *next, *first = FIRST_CHUNK(r);
+
+    for (c = r->chunks; c != first; c = next) {
+        next = c->next;
+        c->next = r->spare;
+        r->spare = c;
+    }
+    if (r->big != NULL) {
+        LOCK();
+        free_chunks(r->big);
+        UNLOCK();
+        r->big = NULL;
+    }
+    r->chunks = first;
+    r->cur = (char *)r + REGION_HDR;
+    r->end = (char *)first + REGION_CHUNK;
+}
+
+/*
+ * mm_region_destroy(r)
+ * - 헤더가 든 첫 청크까지 모든 청크를 힙에 돌려준다
+ * - give back every chunk, the first one with the header included
+ */
+void mm_region_destroy(mm_region_t *r)
+{
+    LOCK();
+    free_chunks(r->big);
+    free_chunks(r->spare);
+    free_chunks(r->chunks);
+    UNLOCK();
+}
+
+/*
+ * free_chunks(c)
+ * - 락을 잡은 상태에서 청크 리스트를 힙에 돌려준다
+ * - with the lock held, give a list of chunks back to the heap
+ */
+static void free_chunks(region_chunk_t *c)
+{
+    region_chunk_t *next;
+
+    for (; c != NULL; c = next) {
+        next = c->next;
+        free_block(c);
+    }
+}
+
+/*
+* 풀: 같은 크기의 객체만 담는 할당기. 페이지 크기 청크에서 객체를 잘라 쓰고, free된 객체는
+* 객체 자리에 next 포인터를 쓴 단일 연결 리스트(intrusive)에 넣는다. 객체마다 헤더가 없고
+* alloc/free는 O(1)이다. 청크는 destroy 때 힙에 돌려준다. 풀은 전역 리스트에 걸어 mm_heapstat이
+* 풀 메모리를 셀 수 있게 한다. 풀 하나는 한 스레드가 쓴다 (청크를 받을 때만 락).
+* pools: allocators for objects of one size. Objects are cut from page
+* sized chunks, and freed objects go on a free list threaded through the
+* objects themselves, so there is no per-object header and alloc and free
+* are O(1). Chunks go back to the heap when the pool is destroyed. Pools
+* are kept on a list so that mm_heapstat can count their memory. A pool
+* is used by one thread at a time; only getting chunks takes the lock.
+*/
+#define POOL_CHUNK  (1<<12)                             // 청크의 페이로드 (chunk payload)
+#define POOL_HDR    ALIGN(sizeof(pool_chunk_t))         // 청크 맨 앞의 next 포인터
+#define POOL_NEXT(p) (*(void **)(p))                    // free 객체 안의 next (intrusive)
+
+typedef struct pool_chunk {
+    struct pool_chunk *next;
+} pool_chunk_t;
+
+struct mm_pool {
+    size_t objsize;             // 정렬된 객체 크기 (aligned object size)
+    void *free;                 // free 객체 리스트 (free objects)
+    char *cur;                  // 아직 안 자른 곳 (uncut part of the newest chunk)
+    char *end;
+    pool_chunk_t *chunks;       // 모든 청크 (every chunk)
+    size_t chunk_bytes;         // 청크 블록 크기의 합 (bytes of the chunks' blocks)
+    size_t live;                // 쓰는 객체 수 (objects in use)
+    struct mm_pool *prev;       // 풀 리스트 (the list of pools)
+    struct mm_pool *next;
+};
+
+/*
+ * mm_pool_create(objsize)
+ * - objsize 바이트 객체의 풀을 만든다. 풀 헤더는 보통 블록 하나다.
+ * - make a pool of objsize byte objects; the header is an ordinary block
+ */
+mm_pool_t *mm_pool_create(size_t objsize)
+{
+    mm_pool_t *pool;
+
+    if (objsize == 0)
+        return NULL;
+    LOCK();
+    if ((pool = malloc_block(sizeof(mm_pool_t))) == NULL) {
+        UNLOCK();
+        return NULL;
+    }
+    pool->objsize = ALIGN(MAX(objsize, sizeof(void *)));
+    pool->free = NULL;
+    pool->cur = pool->end = NULL;
+    pool->chunks = NULL;
+    pool->chunk_bytes = 0;
+    pool->live = 0;
+    pool->prev = NULL;
+    pool->next = pool_list;
+    if (pool_list != NULL)
+        pool_list->prev = pool;
+    pool_list = pool;
+    UNLOCK();
+    return pool;
+}
+
+/*
+ * mm_pool_alloc(pool)
+ * - free 리스트의 맨 앞, 없으면 청크의 남은 곳, 그것도 없으면 새 청크에서 객체를 준다
+ * - take the first free object, else cut one from the newest chunk, else
+ *   get a new chunk
+ */
+void *mm_pool_alloc(mm_pool_t *pool)
+{
+    pool_chunk_t *c;
+    size_t size;
+    void *p;
+
+    if ((p = pool->free) != NULL) {
+        pool->free = POOL_NEXT(p);
+        pool->live++;
+        return p;
+    }
+    if ((size_t)(pool->end - pool->cur) < pool->objsize) {
+        size = MAX(POOL_CHUNK, POOL_HDR + pool->objsize);
+        LOCK();
+        c = malloc_block(size);
+        if (c != NULL)
+            pool->chunk_bytes += GET_SIZE(HDRP(c));
+        UNLOCK();
+        if (c == NULL)
+            return NULL;
+        c->next = pool->chunks;
+        pool->chunks = c;
+        pool->cur = (char *)c + POOL_HDR;
+        pool->end = (char *)c + size;
+    }
+    p = pool->cur;
+    pool->cur += pool->objsize;
+    pool->live++;
+    return p;
+}
+
+/*
+ * mm_pool_free(pool, p)
+ * - 객체를 free 리스트 앞에 넣는다
+ * - push the object onto the pool's free list
+ */
+void mm_pool_free(mm_pool_t *pool, void *p)
+{
+    POOL_NEXT(p) = pool->free;
+    pool->free = p;
+    pool->live--;
+}
+
+/*
+ * mm_pool_destroy(pool)
+ * - 모든 청크와 풀 헤더를 힙에 돌려준다
+ * - give every chunk and the pool header back to the heap
+ */
+void mm_pool_destroy(mm_pool_t *pool)
+{
+    pool_chunk_t *c, *next;
+
+    LOCK();
+    for (c = pool->chunks; c != NULL; c = next) {
+        next = c->next;
+        free_block(c);
+    }
+    if (pool->prev != NULL)
+        pool->prev->next = pool->next;
+    else
+        pool_list = pool->next;
+    if (pool->next != NULL)
+        pool->next->prev = pool->prev;
+    free_block(pool);
+    UNLOCK();
+}
+
+/*
+ * mm_malloc_site(size, site), mm_malloc_at(size, file, line)
+ * - mm_malloc 하고 site_every 번에 한 번은 그 호출 위치에 할당 수, 바이트, 시간을 매긴다
+ * - mm_malloc, and once in site_every calls charge the allocation to its
+ *   call site: a number (as in a trace) or MM_MALLOC_HERE's file and line
+ */
+void *mm_malloc_site(size_t size, unsigned int site)
+{
+    return mm_malloc_at(size, NULL, site);
+}
+
+#ifdef SITE_PROFILE
+void *mm_malloc_at(size_t size, const char *file, unsigned int line)
+{
+    site_t *s;
+    void *bp;
+    unsigned long long t0;
+
+    if (++site_tick < site_every || (s = site_lookup(file, line)) == NULL)
+        return mm_malloc(size);
+    site_tick = 0;
+    t0 = site_ns();
+    if ((bp = mm_malloc(size + WSIZE)) == NULL)
+        return NULL;
+    // 블록은 아직 우리 것이라 락 없이 표시한다 (the block is still ours alone)
+    PUT(HDRP(bp), GET(HDRP(bp)) | SITED);
+    PUT(FTRP(bp), GET(FTRP(bp)) | SITED);
+    *SITEP(bp) = s - site_tab;
+    __atomic_fetch_add(&s->count, 1, __ATOMIC_RELAXED);
+    site_charge(s, size, GET_SIZE(HDRP(bp)), site_ns() - t0);
+    return bp;
+}
+
+/*
+ * mm_site_sample(every)
+ * - 스레드마다 every 번의 mm_malloc_site 중 한 번만 기록한다 (0이나 1이면 전부)
+ * - record one mm_malloc_site call in every, per thread (0 or 1: all of them)
+ */
+void mm_site_sample(unsigned int every)
+{
+    site_every = (every > 1) ? every : 1;
+}
+
+/*
+ * mm_site_dump(fp, top)
+ * - 시간을 가장 많이 쓴 사이트 top개를 찍는다. 표본 추출 중이면 site_every를 곱한 추정치다.
+ * - print the top sites by time spent. While sampling the counts are
+ *   estimates, scaled up by site_every.
+ */
+void mm_site_dump(FILE *fp, int top)
+{
+    int idx[SITE_MAX], n = 0, i, j, k;
+    unsigned long long ns = 0;
+    site_t *s;
+    char name[64];
+
+    for (i = 0; i < SITE_MAX; i++) {
+        if (__atomic_load_n(&site_tab[i].state, __ATOMIC_ACQUIRE) != 2)
+            continue;
+        ns += site_tab[i].ns;
+        // 시간 순 삽입 정렬 (insertion sort by time)
+        for (j = n++; j > 0 && site_tab[idx[j-1]].ns < site_tab[i].ns; j--)
+            idx[j] = idx[j-1];
+        idx[j] = i;
+    }
+    if (site_every > 1)
+        fprintf(fp, "sampled 1 in %u calls, counts scaled up\n", site_every);
+    fprintf(fp, "%-24s%10s%12s%10s%10s%9s%7s\n", "site", "allocs", "bytes",
+            "live KB", "peak KB", "ns/alloc", "time");
+    for (k = 0; k < n && k < top; k++) {
+        s = &site_tab[idx[k]];
+        if (s->file != NULL)
+            snprintf(name, sizeof(name), "%s:%u", s->file, s->line);
+        else
+            snprintf(name, sizeof(name), "#%u", s->line);
+        fprintf(fp, "%-24s%10lu%12llu%10.1f%10.1f%9.0f%6.1f%%\n", name,
+                s->count * site_every, s->bytes * site_every,
+                s->live * (double)site_every / 1024,
+                s->peak * (double)site_every / 1024,
+                (double)s->ns / s->count, ns ? 100.0 * s->ns / ns : 0);
+    }
+}
+
+/*
+ * site_lookup(file, line)
+ * - 사이트의 칸을 찾고 없으면 CAS로 빈 칸을 차지한다. 표가 차면 NULL.
+ * - find the site's slot, or claim an empty one with a CAS; NULL if the
+ *   table is full. A slot being filled is only ever two stores away
+ *   from ready, so waiting for it is short.
+ */
+static site_t *site_lookup(const char *file, unsigned int line)
+{
+    unsigned int h = ((unsigned int)(size_t)file ^ (line * 2654435761u)) & (SITE_MAX - 1);
+    unsigned int state, i;
+    site_t *s;
+
+    for (i = 0; i < SITE_MAX; i++, h = (h + 1) & (SITE_MAX - 1)) {
+        s = &site_tab[h];
+        state = __atomic_load_n(&s->state, __ATOMIC_ACQUIRE);
+        if (state == 0 && __atomic_compare_exchange_n(&s->state, &state, 1, 0,
+                                                      __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+            s->file = file;
+            s->line = line;
+            site_dirty = 1;
+            __atomic_store_n(&s->state, 2, __ATOMIC_RELEASE);
+            return s;
+        }
+        while (state == 1)
+            state = __atomic_load_n(&s->state, __ATOMIC_ACQUIRE);
+        if (s->file == file && s->line == line)
+            return s;
+    }
+    return NULL;
+}
+
+/*
+ * site_charge(s, bytes, blk, ns)
+ * - 요청 바이트, 가진 블록 바이트의 증감, 걸린 시간을 원자적으로 더한다
+ * - add bytes requested, the change in block bytes held and the time taken
+ */
+static void site_charge(site_t *s, size_t bytes, long long blk, unsigned long long ns)
+{
+    long long live, peak;
+
+    if (bytes > 0)
+        __atomic_fetch_add(&s->bytes, bytes, __ATOMIC_RELAXED);
+    live = __atomic_add_fetch(&s->live, blk, __ATOMIC_RELAXED);
+    peak = __atomic_load_n(&s->peak, __ATOMIC_RELAXED);
+    while (live > peak && !__atomic_compare_exchange_n(&s->peak, &peak, live, 1,
+                                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+    __atomic_fetch_add(&s->ns, ns, __ATOMIC_RELAXED);
+}
+
+static unsigned long long site_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * site_free(bp), site_realloc(ptr, size)
+ * - 사이트가 적힌 블록의 free와 realloc. realloc한 블록은 사이트를 그대로 가져간다.
+ * - free and realloc of a block that carries a site. A reallocated block
+ *   keeps its site, in the last word of wherever it ends up.
+ */
+static void site_free(void *bp)
+{
+    site_t *s = &site_tab[*SITEP(bp)];
+    long long blk = GET_SIZE(HDRP(bp));
+    unsigned long long t0 = site_ns();
+
+    free_ptr(bp);
+    site_charge(s, 0, -blk, site_ns() - t0);
+}
+
+static void *site_realloc(void *ptr, size_t size)
+{
+    unsigned int i = *SITEP(ptr);
+    long long blk = GET_SIZE(HDRP(ptr));
+    unsigned long long t0 = site_ns();
+    void *new_ptr;
+
+    if (size == 0) {
+        site_free(ptr);
+        return NULL;
+    }
+    if ((new_ptr = realloc_ptr(ptr, size + WSIZE)) == NULL)
+        return NULL;
+    PUT(HDRP(new_ptr), GET(HDRP(new_ptr)) | SITED);
+    PUT(FTRP(new_ptr), GET(FTRP(new_ptr)) | SITED);
+    *SITEP(new_ptr) = i;
+    site_charge(&site_tab[i], 0, (long long)GET_SIZE(HDRP(new_ptr)) - blk, site_ns() - t0);
+    return new_ptr;
+}
+#else
+void *mm_malloc_at(size_t size, const char *file, unsigned int line)
+{
+    return mm_malloc(size);
+}
+
+void mm_site_sample(unsigned int every)
+{
+}
+
+void mm_site_dump(FILE *fp, int top)
+{
+    fprintf(fp, "mm.c was built without SITE_PROFILE\n");
+}
+#endif
+
+/*
+ * mm_set_root(p), mm_get_root
+ * - 다음 프로세스가 찾을 포인터 하나를 둔다. PERSIST면 힙 안에 오프셋으로 둔다.
+ * - keep one pointer for the next process to find, as an offset in the
+ *   heap with PERSIST
+ */
+void mm_set_root(void *p)
+{
+    LOCK();
+#ifdef PERSIST
+    mm_root->user = HEAP_OFF(p);
+#else
+    user_root = p;
+#endif
+    UNLOCK();
+}
+
+void *mm_get_root(void)
+{
+    void *p;
+
+    LOCK();
+#ifdef PERSIST
+    p = HEAP_PTR(mm_root->user);
+#else
+    p = user_root;
+#endif
+    UNLOCK();
+    return p;
+}
+
+/*
+ * mm_sync
+ * - 지금까지 바꾼 힙을 힙 파일에 쓰고 다 쓰면 돌아온다 (durability point)
+ * - write the heap as it is now to the heap file and return once it is
+ *   there. Takes the lock so that no op is half done in what is written.
+ */
+int mm_sync(void)
+{
+    int ret;
+
+    LOCK();
+    ret = mem_sync();
+    UNLOCK();
+    return ret;
+}
+
+/*
+ * mm_features
+ * - 이 빌드가 켠 MM_* 기능 (the MM_* features this build has)
+ */
+unsigned int mm_features(void)
+{
+    unsigned int f = 0;
+
+#ifdef THREAD_SAFE
+    f |= MM_THREAD_SAFE;
+#endif
+#ifdef REMOTE_FREE
+    f |= MM_REMOTE_FREE;
+#endif
+#ifdef SITE_PROFILE
+    f |= MM_SITE_PROFILE;
+#endif
+#ifdef PERSIST
+    f |= MM_PERSIST;
+#endif
+    return f;
+}
+
+/*
+ * mm_touch
+ * - 힙 밖에 있는 mm.c의 상태(전역 변수, 표, 옆 배열)의 모든 페이지를 제자리에 다시 쓴다.
+ *   fork한 자식이 시간을 재기 전에 copy-on-write 폴트를 다 받게 한다.
+ * - write every page of mm.c's own state outside the heap (its globals,
+ *   tables and side arrays) back to itself, so that a forked child takes
+ *   all of its copy-on-write faults before it starts a clock
+ */
+#define TOUCH(x)    touch_pages(&(x), sizeof(x))
+
+static void touch_pages(void *p, size_t len)
+{
+    volatile char *c = p;
+    size_t off, pg = mem_pagesize();
+
+    for (off = 0; off < len; off += pg)
+        c[off] = c[off];
+    c[len - 1] = c[len - 1];
+}
+
+void mm_touch(void)
+{
+#ifdef PERSIST
+    TOUCH(heap_base);
+    TOUCH(mm_root);
+#else
+    TOUCH(heap_listp);
+    TOUCH(free_listp);
+    TOUCH(user_root);
+#ifdef NEXT_FIT
+    TOUCH(last_bp);
+#endif
+#endif
+    TOUCH(pool_list);
+#ifdef THREAD_SAFE
+    TOUCH(mm_lock);
+#endif
+#ifdef TLSF
+    TOUCH(tlsf_head);
+    TOUCH(fl_bitmap);
+    TOUCH(sl_bitmap);
+#endif
+#ifdef SIZE_ARRAY
+    TOUCH(sa_count);
+    if (sa_size != NULL)  // 한 매핑에 두 배열 (both arrays are one mapping)
+        touch_pages(sa_size, 2 * SA_MAX * sizeof(unsigned int));
+#endif
+#ifdef REMOTE_FREE
+    TOUCH(owner_tab);
+    TOUCH(remote_head);
+    TOUCH(tid_live);
+    TOUCH(orphans);
+    TOUCH(my_tid);
+#endif
+#ifdef SITE_PROFILE
+    TOUCH(site_tab);
+    TOUCH(site_dirty);
+    TOUCH(site_tick);
+#endif
+}
+
+/*
+ * mm_heapstat(st)
+ * - 힙 전체를 묵시적으로 순회하며 할당/가용 블록의 수와 크기를 센다
+ * - walk every block from the prologue to the epilogue and count them
+ */
+void mm_heapstat(mm_heapstat_t *st)
+{
+    char *bp;
+    size_t size;
+    mm_pool_t *pool;
+
+    LOCK();
+#ifdef REMOTE_FREE
+    drain_all();  // 원격 free도 반영 (count remote frees as free)
+#endif
+    memset(st, 0, sizeof(*st));
+    st->heap_bytes = mem_heapsize();
+    if (POISONED()) {  // 망가진 힙은 세지 않는다 (a poisoned heap is not walked)
+        UNLOCK();
+        return;
+    }
+    for (bp = SUCC_BLKP(heap_listp); GET_SIZE(HDRP(bp)) > 0; bp = SUCC_BLKP(bp)) {
+        size = GET_SIZE(HDRP(bp));
+        if (GET_ALLOC(HDRP(bp))) {
+            st->alloc_blocks++;
+            st->alloc_bytes += size;
+        } else {
+            st->free_blocks++;
+            st->free_bytes += size;
+            if (size > st->largest_free)
+                st->largest_free = size;
+        }
+    }
+    // 풀의 청크는 할당 블록으로도 세었다 (pool chunks are allocated blocks too)
+    for (pool = pool_list; pool != NULL; pool = pool->next) {
+        st->pool_bytes += pool->chunk_bytes;
+        st->pool_used += pool->live * pool->objsize;
+    }
+    UNLOCK();
+}
+
+/*
+ * mm_heapmap(map, max)
+ * - 힙의 모든 블록을 (오프셋, 크기|플래그)로 기록하고 블록 수를 리턴한다
+ * - record every block as (offset, size | flags) and return the number of
+ *   blocks. Only the first max are stored; call again with a bigger map
+ *   if the return value exceeds max.
+ */
+int mm_heapmap(mm_mapent_t *map, int max)
+{
+    char *bp, *base = mem_heap_lo();
+    unsigned int off;
+    int n = 0, lo, hi, mid;
+#ifdef TLSF
+    int fl, sl;
+#endif
+#ifdef SIZE_ARRAY
+    unsigned int i;
+#endif
+
+    LOCK();
+#ifdef REMOTE_FREE
+    drain_all();
+#endif
+    if (POISONED()) {
+        UNLOCK();
+        return 0;
+    }
+    for (bp = SUCC_BLKP(heap_listp); GET_SIZE(HDRP(bp)) > 0; bp = SUCC_BLKP(bp), n++) {
+        if (n < max) {
+            map[n].offset = bp - base;
+            map[n].info = GET_SIZE(HDRP(bp)) | GET_ALLOC(HDRP(bp));
+        }
+    }
+
+    /* 
+     * 맵은 주소 순이므로 free list의 각 블록을 이진 탐색으로 찾아 표시한다
+     * the map is in address order: binary search for each free list block
+     */
+    if (n <= max) {
+#ifdef TLSF
+        for (fl = 0; fl < FL_COUNT; fl++)
+        for (sl = 0; sl < SL_COUNT; sl++)
+        for (bp = tlsf_head[fl][sl]; bp != NULL; bp = NEXT_FREEP(bp)) {
+#elif defined(SIZE_ARRAY)
+        for (i = 0; bp = SA_BLKP(i), i < sa_count; i++) {
+#else
+        for (bp = free_listp; GET_ALLOC(HDRP(bp)) != 1; bp = NEXT_FREEP(bp)) {
+#endif
+            off = bp - base;
+            lo = 0;
+            hi = n - 1;
+            while (lo <= hi) {
+                mid = (lo + hi) / 2;
+                if (map[mid].offset == off) {
+                    map[mid].info |= MM_MAP_LISTED;
+                    break;
+                }
+                if (map[mid].offset < off)
+                    lo = mid + 1;
+                else
+                    hi = mid - 1;
+            }
+        }
+    }
+    UNLOCK();
+    return n;
+}
+
+/*
+ * delete_node(bp) 
+ * - 할당되거나 연결되는 가용 블록을 free list에서 없앤다
+ * - remove pointed block from the free list
+ */
+void delete_node(void *bp){
+#ifdef SIZE_ARRAY
+    /* 마지막 칸을 빈 칸으로 옮긴다 (move the last slot into the hole) */
+    unsigned int i = SLOT(bp);
+
+    if (i != --sa_count) {
+        sa_size[i] = sa_size[sa_count];
+        sa_off[i] = sa_off[sa_count];
+        SLOT(SA_BLKP(i)) = i;
+    }
+#else
+    void *next = (void *) NEXT_FREEP(bp);
+    void *prev = (void *) PREV_FREEP(bp);
+#ifdef TLSF
+    int fl, sl;
+
+    if (prev == NULL) { /* Start of the list: 비면 비트를 끈다 (clear its bits if empty) */
+        tlsf_mapping(GET_SIZE(HDRP(bp)), &fl, &sl);
+        tlsf_head[fl][sl] = next;
+        if (next == NULL) {
+            sl_bitmap[fl] &= ~(1U << sl);
+            if (sl_bitmap[fl] == 0)
+                fl_bitmap &= ~(1U << fl);
+        }
+    } else {
+        SET_NEXT(prev, next);
+    }
+#else
+    if (prev == NULL) { /* Start of the list */
+        SET_FREE_LIST(next);
+    } else {
+        SET_NEXT(prev, next);
     }
     
+#endif
     if (next != NULL) { /* Not the end of list */
         SET_PREV(next, prev);
     }
-}
\ No newline at end of file
+#endif
+}
+
+#ifdef TLSF
+/*
+ * tlsf_mapping(size, fl, sl)
+ * - 블록 크기의 1단계, 2단계 리스트 번호. 블록은 MINBLOCK(>= 2^SL_LOG2) 이상이다.
+ * - the first and second level list of a block size. Blocks are at least
+ *   MINBLOCK >= 2^SL_LOG2 bytes, so fl - SL_LOG2 is never negative.
+ */
+static void tlsf_mapping(size_t size, int *fl, int *sl)
+{
+    *fl = FLS(size);
+    *sl = (size >> (*fl - SL_LOG2)) & (SL_COUNT - 1);
+}
+#endif
+
+#ifdef SIZE_ARRAY
+/*
+ * sa_map
+ * - 두 배열을 한 번에 매핑한다. 예약만 하므로 쓰는 칸의 페이지만 메모리를 쓴다.
+ * - map both arrays at once. The mapping is only reserved, so memory is
+ *   taken only for the pages that slots in use touch.
+ */
+static int sa_map(void)
+{
+    void *p = mmap(NULL, 2 * SA_MAX * sizeof(unsigned int), PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+    if (p == MAP_FAILED)
+        return -1;
+    sa_size = p;
+    sa_off = sa_size + SA_MAX;
+    return 0;
+}
+
+/*
+ * sa_find(asize)
+ * - 크기가 asize 이상인 첫 칸을 벡터 비교로 찾는다. 없으면 -1.
+ *   크기는 2^31보다 작으므로 부호 있는 비교 size > asize-1 로 충분하다.
+ *   배열 끝은 벡터 하나만큼 여유가 있어 sa_count 뒤를 읽어도 되고, 그 결과는 버린다.
+ * - find the first slot whose size is at least asize with vector
+ *   compares, or -1. Sizes are below 2^31, so the signed compare
+ *   size > asize-1 does. The arrays have a vector of slack at the end, so
+ *   reading past sa_count is safe; hits there are thrown away.
+ */
+static int sa_find(unsigned int asize)
+{
+    unsigned int i = 0;
+
+#if defined(__AVX2__)
+    unsigned int mask;
+    __m256i key = _mm256_set1_epi32((int)asize - 1);
+
+    for (; i < sa_count; i += 8) {
+        mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(
+                   _mm256_loadu_si256((__m256i *)&sa_size[i]), key)));
+        if (mask != 0) {
+            i += __builtin_ctz(mask);
+            return (i < sa_count) ? (int)i : -1;
+        }
+    }
+#elif defined(__SSE2__)
+    unsigned int mask;
+    __m128i key = _mm_set1_epi32((int)asize - 1);
+
+    for (; i < sa_count; i += 4) {
+        mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(
+                   _mm_loadu_si128((__m128i *)&sa_size[i]), key)));
+        if (mask != 0) {
+            i += __builtin_ctz(mask);
+            return (i < sa_count) ? (int)i : -1;
+        }
+    }
+#elif defined(__ARM_NEON)
+    uint32x4_t key = vdupq_n_u32(asize);
+    uint16x4_t ge;
+
+    for (; i < sa_count; i += 4) {
+        // 네 칸의 비교 결과를 16비트씩으로 줄여 64비트 하나로 본다 (narrow to one 64-bit word)
+        ge = vmovn_u32(vcgeq_u32(vld1q_u32(&sa_size[i]), key));
+        if (vget_lane_u64(vreinterpret_u64_u16(ge), 0) != 0) {
+            while (sa_size[i] < asize)
+                i++;
+            return (i < sa_count) ? (int)i : -1;
+        }
+    }
+#else
+    /* 스칼라 (scalar fallback) */
+    for (; i < sa_count; i++)
+        if (sa_size[i] >= asize)
+            return (int)i;
+#endif
+    return -1;
+}
+#endif
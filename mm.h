@@ -5,6 +5,122 @@ extern void *mm_malloc (size_t size);
 extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
 
+/*
+ * A region: objects are bump-allocated from chunks of the heap and are
+ * never freed one by one. mm_region_reset frees every object of the
+ * region at once and mm_region_destroy frees the region itself. Objects
+ * must not be passed to mm_free or mm_realloc. mm_init empties the heap,
+ * regions included.
+ */
+typedef struct mm_region mm_region_t;
+
+extern mm_region_t *mm_region_create(void);
+extern void *mm_region_alloc(mm_region_t *r, size_t size);
+extern void mm_region_reset(mm_region_t *r);
+extern void mm_region_destroy(mm_region_t *r);
+
+/*
+ * A pool of objects of one size, with no per-object header: alloc
+ * and free are O(1). A pool keeps its memory until it is destroyed.
+ * Like a region, a pool is used by one thread at a time.
+ */
+typedef struct mm_pool mm_pool_t;
+
+extern mm_pool_t *mm_pool_create(size_t objsize);
+extern void *mm_pool_alloc(mm_pool_t *pool);
+extern void mm_pool_free(mm_pool_t *pool, void *p);
+extern void mm_pool_destroy(mm_pool_t *pool);
+
+/*
+ * Allocation sites: mm_malloc_site charges each allocation to a call
+ * site, given by a number (as in a trace) or, with MM_MALLOC_HERE, by
+ * file and line. Each site counts allocations, bytes requested, block
+ * bytes held (now and at most), and the time spent in malloc, realloc
+ * and free of its blocks (with make SITE_PROFILE=1; otherwise
+ * mm_malloc_site is mm_malloc). The table takes no lock. mm_site_sample(n)
+ * records one call in n per thread to keep the overhead down, and
+ * mm_site_dump scales the counts back up. mm_init clears the table.
+ */
+#define MM_MALLOC_HERE(size) mm_malloc_at((size), __FILE__, __LINE__)
+
+extern void *mm_malloc_site(size_t size, unsigned int site);
+extern void *mm_malloc_at(size_t size, const char *file, unsigned int line);
+extern void mm_site_sample(unsigned int every);
+extern void mm_site_dump(FILE *fp, int top);
+
+/*
+ * A persistent heap: built with make PERSIST=1 and mapped from a heap
+ * file (mem_set_file in memlib.h), mm.c keeps its free list and roots
+ * as offsets in the heap, and mm_init reattaches to the heap the file
+ * already holds, wherever it is now mapped, and returns 1. mm_set_root
+ * keeps one pointer, say to an index, for the next process to find with
+ * mm_get_root. mm_sync returns once the heap is in the file; changes
+ * made after the last mm_sync may or may not survive a crash, and a
+ * crash in the middle of an op can leave the heap broken. Regions and
+ * pools hold pointers and do not survive a reattach.
+ * With make THREAD_SAFE=1 as well, when a process dies holding the
+ * heap's lock the next one to take it checks the heap. If it is broken,
+ * the heap is poisoned: mm_malloc and mm_realloc return NULL, mm_free
+ * does nothing and mm_init refuses to reattach (-1), until the heap is
+ * made anew (mem_reset_brk, then mm_init).
+ */
+extern int mm_sync(void);
+extern void mm_set_root(void *p);
+extern void *mm_get_root(void);
+
+/*
+ * What this build of mm.c can do: mm_features returns the MM_* bits of
+ * the options it was built with (see the Makefile). Without
+ * MM_THREAD_SAFE, the heap must be used by one thread at a time.
+ */
+#define MM_THREAD_SAFE  0x1  /* one lock around the heap (make THREAD_SAFE=1) */
+#define MM_REMOTE_FREE  0x2  /* lock-free frees of other threads' blocks
+                                (make REMOTE_FREE=1) */
+#define MM_SITE_PROFILE 0x4  /* mm_malloc_site keeps its table
+                                (make SITE_PROFILE=1) */
+#define MM_PERSIST      0x8  /* mm_init reattaches to a heap file or shared
+                                memory object (make PERSIST=1) */
+
+extern unsigned int mm_features(void);
+
+/*
+ * mm_touch writes every page of the allocator's own state outside the
+ * heap (globals, tables, side arrays) back to itself, so that a forked
+ * child takes its copy-on-write faults there before it times anything.
+ */
+extern void mm_touch(void);
+
+/* 
+ * A snapshot of the heap, as counted by walking every block 
+ */
+typedef struct {
+    size_t heap_bytes;   /* bytes obtained from mem_sbrk */
+    size_t alloc_blocks; /* number of allocated blocks */
+    size_t alloc_bytes;  /* bytes in allocated blocks, headers included */
+    size_t free_blocks;  /* number of free blocks */
+    size_t free_bytes;   /* bytes in free blocks */
+    size_t largest_free; /* size of the largest free block */
+    size_t pool_bytes;   /* bytes in pool chunks, also in alloc_bytes */
+    size_t pool_used;    /* bytes of the pool objects in use */
+} mm_heapstat_t;
+
+extern void mm_heapstat(mm_heapstat_t *st);
+
+/*
+ * One block of a heap map: its offset from the start of the heap and
+ * its size, with the low bits used for flags
+ */
+typedef struct {
+    unsigned int offset; /* block pointer - mem_heap_lo() */
+    unsigned int info;   /* block size | MM_MAP_* flags */
+} mm_mapent_t;
+
+#define MM_MAP_ALLOC  0x1  /* allocated bit in the header */
+#define MM_MAP_LISTED 0x2  /* reachable from the free list */
+#define MM_MAP_SIZE(e) ((e).info & ~0x7)
+
+extern int mm_heapmap(mm_mapent_t *map, int max);
+
 
 /* 
  * Students work in teams of one or two.  Teams enter their team name, 
@@ -0,0 +1,393 @@
+/*
+ * mm_buddy.c
+ *
+ * 이진 버디 할당기. mm.c와 같은 memlib 힙 위에서 동작하며 mdriver -A buddy로 고른다.
+ * 블록 크기는 2의 거듭제곱이고 헤더가 없다: 블록의 order는 옆 테이블에, 가용 여부는
+ * order별 비트맵에 둔다. 버디 주소는 오프셋 XOR 크기로 O(1)에 구한다.
+ *
+ * Binary buddy allocator on the same memlib heap as mm.c, selected with
+ * mdriver -A buddy. Blocks are powers of two with no header: the order of
+ * each block is kept in a side table with one byte per 16 heap bytes, and
+ * which blocks are free in one bitmap per order, so a payload of 64 bytes
+ * takes a 64 byte block. A block's buddy is its offset XOR its size.
+ * Each order has its own doubly linked free list, and a mask of the
+ * non-empty lists finds the smallest block that fits in one bit scan.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "mm.h"
+#include "mm_buddy.h"
+#include "memlib.h"
+#include "config.h"
+
+/* 상수 (constants) */
+#define UNIT       16                  // 옆 테이블 한 칸의 바이트 (bytes per side table entry)
+#define MIN_ORDER  (ALIGNMENT > UNIT ? __builtin_ctz(ALIGNMENT) : 4)  // 가장 작은 블록 2^4
+#define MAX_ORDER  24                  // 16MB: MAX_HEAP 안의 가장 큰 블록 (largest block)
+#define NUM_ORDERS (MAX_ORDER + 1)
+#define ALLOCATED  0x80                // 옆 테이블의 할당 비트 (allocated bit in the table)
+
+/* 오프셋 <-> 블록 (offsets from base <-> block pointers) */
+#define BLOCK(off)   (base + (off))
+#define OFFSET(bp)   ((size_t)((char *)(bp) - base))
+#define SIZE(k)      ((size_t)1 << (k))
+#define TAB(off)     (order_tab[(off) / UNIT])
+
+/* order k의 가용 비트맵에서 off 블록의 비트 (bit of block off in order k's bitmap) */
+#define BITWORD(k, off)  (free_bits[bits_at[k] + ((off) >> (k)) / 32])
+#define BITMASK(k, off)  (1U << (((off) >> (k)) % 32))
+#define IS_FREE(k, off)  (BITWORD(k, off) & BITMASK(k, off))
+
+/* 가용 블록의 페이로드에 쓰는 리스트 노드 (free list links, in the payload) */
+typedef struct node {
+    struct node *prev;
+    struct node *next;
+} node_t;
+
+static pthread_mutex_t buddy_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static char *base;                  // 첫 블록 (offset 0)
+static size_t brk_off;              // 힙 끝의 오프셋 (offset of the heap's end)
+static size_t hi_off;               // 지금까지 가장 높은 brk_off (highest ever, for init)
+static node_t *heads[NUM_ORDERS];   // order별 가용 리스트 (free list per order)
+static unsigned int order_mask;     // 비어있지 않은 리스트 (non-empty lists)
+static unsigned char order_tab[MAX_HEAP / UNIT];
+static unsigned int free_bits[(MAX_HEAP / UNIT) / 16 + NUM_ORDERS];
+static unsigned int bits_at[NUM_ORDERS];   // order별 비트맵의 첫 워드 (first word per order)
+
+static int order_of(size_t size);
+static void push(int k, size_t off);
+static void unlink_block(int k, size_t off);
+static void release(size_t off, int k);
+static long grow(int k);
+
+/*
+ * buddy_init
+ * - 힙 시작을 정렬하고 리스트와 비트맵을 비운다
+ * - align the start of the heap and empty the lists and bitmaps
+ */
+int buddy_init(void)
+{
+    size_t pad, words;
+    int k, at = 0;
+
+    pthread_mutex_lock(&buddy_lock);
+    for (k = MIN_ORDER; k < NUM_ORDERS; k++) {
+        bits_at[k] = at;
+        at += (MAX_HEAP >> k) / 32 + 1;
+    }
+    memset(heads, 0, sizeof(heads));
+
+    /* 지난 힙이 쓴 만큼만 지운다 (only clear what the last heap used) */
+    for (k = MIN_ORDER; k < NUM_ORDERS; k++) {
+        words = (hi_off >> k) / 32 + 1;
+        memset(&free_bits[bits_at[k]], 0, words * sizeof(unsigned int));
+    }
+    order_mask = 0;
+    brk_off = hi_off = 0;
+
+    pad = (ALIGNMENT - ((size_t)mem_heap_hi() + 1) % ALIGNMENT) % ALIGNMENT;
+    if ((base = mem_sbrk(pad)) == (void *)-1) {
+        pthread_mutex_unlock(&buddy_lock);
+        return -1;
+    }
+    base += pad;
+    pthread_mutex_unlock(&buddy_lock);
+    return 0;
+}
+
+/*
+ * buddy_malloc
+ * - 크기에 맞는 order 이상의 가장 작은 가용 블록을 찾아 반씩 나눈다
+ * - take the smallest free block of at least the order needed and split
+ *   it in halves down to that order, freeing the upper halves
+ */
+void *buddy_malloc(size_t size)
+{
+    unsigned int avail;
+    long off;
+    int k, j;
+
+    if (size == 0 || (k = order_of(size)) > MAX_ORDER)
+        return NULL;
+
+    pthread_mutex_lock(&buddy_lock);
+    avail = order_mask & (~0U << k);
+    if (avail != 0) {
+        j = __builtin_ctz(avail);
+        off = OFFSET(heads[j]);
+        unlink_block(j, off);
+        while (j > k) {
+            j--;
+            push(j, off + SIZE(j));
+        }
+    }
+    else if ((off = grow(k)) < 0) {
+        pthread_mutex_unlock(&buddy_lock);
+        return NULL;
+    }
+    TAB(off) = k | ALLOCATED;
+    pthread_mutex_unlock(&buddy_lock);
+    return BLOCK(off);
+}
+
+/*
+ * buddy_free
+ * - 버디가 가용이면 합치기를 반복한다
+ * - free a block, merging it with its buddy for as long as that is free
+ */
+void buddy_free(void *ptr)
+{
+    size_t off = OFFSET(ptr);
+
+    pthread_mutex_lock(&buddy_lock);
+    release(off, TAB(off) & ~ALLOCATED);
+    pthread_mutex_unlock(&buddy_lock);
+}
+
+/*
+ * buddy_realloc
+ * - 줄일 때는 위쪽 절반들을 돌려주고, 늘릴 때는 위쪽 버디들이 모두 가용이면 제자리에서
+ *   합친다. 안 되면 새로 할당해 복사한다.
+ * - shrink in place by freeing upper halves; grow in place if the buddies
+ *   above are all free; otherwise allocate, copy and free
+ */
+void *buddy_realloc(void *ptr, size_t size)
+{
+    size_t off;
+    int k, old, j;
+    void *newptr;
+
+    if (ptr == NULL)
+        return buddy_malloc(size);
+    if (size == 0) {
+        buddy_free(ptr);
+        return NULL;
+    }
+    if ((k = order_of(size)) > MAX_ORDER)
+        return NULL;
+
+    pthread_mutex_lock(&buddy_lock);
+    off = OFFSET(ptr);
+    old = TAB(off) & ~ALLOCATED;
+
+    if (k <= old) {
+        while (old > k) {
+            old--;
+            release(off + SIZE(old), old);
+        }
+        TAB(off) = k | ALLOCATED;
+        pthread_mutex_unlock(&buddy_lock);
+        return ptr;
+    }
+
+    /* 제자리 확장: off가 2^k로 정렬되고 위의 버디가 모두 가용이어야 한다 */
+    /* in place: off must be 2^k aligned and every buddy above it free */
+    for (j = old; j < k; j++)
+        if ((off & SIZE(j)) || off + 2*SIZE(j) > brk_off || !IS_FREE(j, off + SIZE(j)))
+            break;
+    if (j == k) {
+        for (j = old; j < k; j++)
+            unlink_block(j, off + SIZE(j));
+        TAB(off) = k | ALLOCATED;
+        pthread_mutex_unlock(&buddy_lock);
+        return ptr;
+    }
+    pthread_mutex_unlock(&buddy_lock);
+
+    if ((newptr = buddy_malloc(size)) == NULL)
+        return NULL;
+    memcpy(newptr, ptr, SIZE(old));
+    buddy_free(ptr);
+    return newptr;
+}
+
+/*
+ * buddy_features
+ * - 버디는 항상 락을 잡는다 (buddy always takes its lock)
+ */
+unsigned int buddy_features(void)
+{
+    return MM_THREAD_SAFE;
+}
+
+/*
+ * buddy_touch
+ * - 힙 밖의 상태의 모든 페이지를 제자리에 다시 쓴다 (mm_touch와 같다)
+ * - write every page of the state outside the heap back to itself, as
+ *   mm_touch does
+ */
+static void touch_pages(void *p, size_t len)
+{
+    volatile char *c = p;
+    size_t off, pg = mem_pagesize();
+
+    for (off = 0; off < len; off += pg)
+        c[off] = c[off];
+    c[len - 1] = c[len - 1];
+}
+
+void buddy_touch(void)
+{
+    touch_pages(&base, sizeof(base));
+    touch_pages(&brk_off, sizeof(brk_off));
+    touch_pages(heads, sizeof(heads));
+    touch_pages(&order_mask, sizeof(order_mask));
+    touch_pages(order_tab, sizeof(order_tab));
+    touch_pages(free_bits, sizeof(free_bits));
+    touch_pages(bits_at, sizeof(bits_at));
+}
+
+/*
+ * buddy_heapstat(st)
+ * - 블록을 주소 순으로 순회하며 센다 (mm_heapstat과 같은 형식)
+ * - walk every block in address order, as mm_heapstat does
+ */
+void buddy_heapstat(mm_heapstat_t *st)
+{
+    size_t off, size;
+
+    pthread_mutex_lock(&buddy_lock);
+    memset(st, 0, sizeof(*st));
+    st->heap_bytes = mem_heapsize();
+    for (off = 0; off < brk_off; off += size) {
+        size = SIZE(TAB(off) & ~ALLOCATED);
+        if (TAB(off) & ALLOCATED) {
+            st->alloc_blocks++;
+            st->alloc_bytes += size;
+        } else {
+            st->free_blocks++;
+            st->free_bytes += size;
+            if (size > st->largest_free)
+                st->largest_free = size;
+        }
+    }
+    pthread_mutex_unlock(&buddy_lock);
+}
+
+/*
+ * buddy_heapmap(map, max)
+ * - mm_heapmap과 같은 형식. 가용 블록은 비트맵에 있으면 LISTED로 표시한다.
+ * - same format as mm_heapmap; a free block is LISTED if its bit is set
+ */
+int buddy_heapmap(mm_mapent_t *map, int max)
+{
+    size_t off, size;
+    int n = 0, k;
+
+    pthread_mutex_lock(&buddy_lock);
+    for (off = 0; off < brk_off; off += size, n++) {
+        k = TAB(off) & ~ALLOCATED;
+        size = SIZE(k);
+        if (n < max) {
+            map[n].offset = BLOCK(off) - (char *)mem_heap_lo();
+            map[n].info = size;
+            if (TAB(off) & ALLOCATED)
+                map[n].info |= MM_MAP_ALLOC;
+            if (IS_FREE(k, off))
+                map[n].info |= MM_MAP_LISTED;
+        }
+    }
+    pthread_mutex_unlock(&buddy_lock);
+    return n;
+}
+
+/*
+ * order_of(size)
+ * - size 바이트가 들어가는 가장 작은 order
+ * - the smallest order whose blocks hold size bytes
+ */
+static int order_of(size_t size)
+{
+    int k = MIN_ORDER;
+
+    if (size > SIZE(MIN_ORDER))
+        k = 8 * sizeof(unsigned long) - __builtin_clzl((unsigned long)size - 1);
+    return k;
+}
+
+/*
+ * push(k, off) / unlink_block(k, off)
+ * - order k 리스트의 앞에 넣거나 빼면서 비트맵과 마스크를 맞춘다
+ * - add a free block at the head of list k, or take it off, keeping the
+ *   bitmap and the mask of non-empty lists in step
+ */
+static void push(int k, size_t off)
+{
+    node_t *node = (node_t *)BLOCK(off);
+
+    node->prev = NULL;
+    node->next = heads[k];
+    if (heads[k] != NULL)
+        heads[k]->prev = node;
+    heads[k] = node;
+    order_mask |= 1U << k;
+    BITWORD(k, off) |= BITMASK(k, off);
+    TAB(off) = k;
+}
+
+static void unlink_block(int k, size_t off)
+{
+    node_t *node = (node_t *)BLOCK(off);
+
+    if (node->prev != NULL)
+        node->prev->next = node->next;
+    else if ((heads[k] = node->next) == NULL)
+        order_mask &= ~(1U << k);
+    if (node->next != NULL)
+        node->next->prev = node->prev;
+    BITWORD(k, off) &= ~BITMASK(k, off);
+}
+
+/*
+ * release(off, k)
+ * - 버디(off ^ 2^k)가 힙 안에 있고 같은 order로 가용이면 합쳐서 한 order 올린다
+ * - while the buddy (off ^ 2^k) lies in the heap and is free at order k,
+ *   merge with it and go up one order; then free the result
+ */
+static void release(size_t off, int k)
+{
+    size_t buddy;
+
+    while (k < MAX_ORDER) {
+        buddy = off ^ SIZE(k);
+        if (buddy + SIZE(k) > brk_off || !IS_FREE(k, buddy))
+            break;
+        unlink_block(k, buddy);
+        off &= ~SIZE(k);
+        k++;
+    }
+    push(k, off);
+}
+
+/*
+ * grow(k)
+ * - 힙 끝을 2^k로 정렬해 order k 블록 하나를 만든다. 정렬로 생긴 틈은 정렬된
+ *   가장 큰 블록들로 잘라 가용 리스트에 넣는다.
+ * - extend the heap by one order k block at the next 2^k aligned offset.
+ *   The gap before it is cut into the largest aligned blocks that fit
+ *   and freed. Returns the new block's offset, or -1.
+ */
+static long grow(int k)
+{
+    size_t start = brk_off, at = (brk_off + SIZE(k) - 1) & ~(SIZE(k) - 1);
+    size_t off;
+    int j;
+
+    if (mem_sbrk(at + SIZE(k) - start) == (void *)-1)
+        return -1;
+
+    for (off = start; off < at; off += SIZE(j)) {
+        for (j = MIN_ORDER; j < k && !(off & SIZE(j)) && off + SIZE(j+1) <= at; j++)
+            ;
+        brk_off = off + SIZE(j);
+        release(off, j);
+    }
+    brk_off = at + SIZE(k);
+    if (brk_off > hi_off)
+        hi_off = brk_off;
+    return at;
+}
@@ -0,0 +1,14 @@
+/*
+ * mm_buddy.h - The binary buddy allocator in mm_buddy.c, an alternative
+ *     to mm.c that mdriver selects with -A buddy
+ */
+#include <stdio.h>
+
+extern int buddy_init(void);
+extern void *buddy_malloc(size_t size);
+extern void buddy_free(void *ptr);
+extern void *buddy_realloc(void *ptr, size_t size);
+extern unsigned int buddy_features(void);
+extern void buddy_touch(void);
+extern void buddy_heapstat(mm_heapstat_t *st);
+extern int buddy_heapmap(mm_mapent_t *map, int max);
@@ -0,0 +1,171 @@
+/*
+ * perfctr.c - Count hardware events around a piece of code with the
+ *     Linux perf_event_open interface
+ *
+ * Each event is opened on its own, not as a group, so that a machine
+ * without (say) a dTLB event still reports the others. If the kernel
+ * multiplexes the counters, the counts are scaled up by the fraction
+ * of the time each counter actually ran.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "perfctr.h"
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+/* Cache event encodings, see perf_event_open(2) */
+#define CACHE_EVENT(cache, op, result) \
+    ((cache) | ((op) << 8) | ((result) << 16))
+
+static const struct {
+    unsigned type;
+    unsigned long long config;
+    const char *name;
+} events[PC_NUM] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles"},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instrs"},
+    {PERF_TYPE_HW_CACHE, CACHE_EVENT(PERF_COUNT_HW_CACHE_L1D, 
+				     PERF_COUNT_HW_CACHE_OP_READ,
+				     PERF_COUNT_HW_CACHE_RESULT_MISS), "L1D"},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, "LLC"},
+    {PERF_TYPE_HW_CACHE, CACHE_EVENT(PERF_COUNT_HW_CACHE_DTLB, 
+				     PERF_COUNT_HW_CACHE_OP_READ,
+				     PERF_COUNT_HW_CACHE_RESULT_MISS), "dTLB"},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, "br"},
+};
+
+static int fds[PC_NUM] = {-1, -1, -1, -1, -1, -1};
+static int open_errno = 0;
+
+/* 
+ * perfctr_init - Open one disabled counter per event for this thread
+ */
+int perfctr_init(void)
+{
+    struct perf_event_attr attr;
+    int i, n = 0;
+
+    for (i = 0; i < PC_NUM; i++) {
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = events[i].type;
+	attr.config = events[i].config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | 
+	    PERF_FORMAT_TOTAL_TIME_RUNNING;
+	fds[i] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+	if (fds[i] < 0)
+	    open_errno = errno;
+	else
+	    n++;
+    }
+    return n;
+}
+
+/* 
+ * perfctr_deinit - Close the counters 
+ */
+void perfctr_deinit(void)
+{
+    int i;
+
+    for (i = 0; i < PC_NUM; i++) {
+	if (fds[i] >= 0)
+	    close(fds[i]);
+	fds[i] = -1;
+    }
+}
+
+/* 
+ * perfctr_start - Zero the counters and start counting 
+ */
+void perfctr_start(void)
+{
+    int i;
+
+    for (i = 0; i < PC_NUM; i++) {
+	if (fds[i] >= 0) {
+	    ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+	    ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+	}
+    }
+}
+
+/* 
+ * perfctr_stop - Stop counting and read the (scaled) counts 
+ */
+void perfctr_stop(perfctr_t *pc)
+{
+    unsigned long long val[3]; /* value, time enabled, time running */
+    int i;
+
+    for (i = 0; i < PC_NUM; i++)
+	if (fds[i] >= 0)
+	    ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+
+    for (i = 0; i < PC_NUM; i++) {
+	pc->count[i] = -1;
+	if (fds[i] < 0 || read(fds[i], val, sizeof(val)) != sizeof(val))
+	    continue;
+	if (val[2] == 0)  /* never got scheduled on the PMU */
+	    continue;
+	pc->count[i] = (double)val[0] * ((double)val[1] / (double)val[2]);
+    }
+}
+
+const char *perfctr_name(int i)
+{
+    return events[i].name;
+}
+
+const char *perfctr_error(void)
+{
+    return strerror(open_errno);
+}
+
+#else /* !__linux__ */
+
+/* No perf_event_open here, so there is never anything to count */
+
+int perfctr_init(void)
+{
+    return 0;
+}
+
+void perfctr_deinit(void)
+{
+}
+
+void perfctr_start(void)
+{
+}
+
+void perfctr_stop(perfctr_t *pc)
+{
+    int i;
+
+    for (i = 0; i < PC_NUM; i++)
+	pc->count[i] = -1;
+}
+
+const char *perfctr_name(int i)
+{
+    static const char *names[PC_NUM] = 
+	{"cycles", "instrs", "L1D", "LLC", "dTLB", "br"};
+    return names[i];
+}
+
+const char *perfctr_error(void)
+{
+    return "perf_event_open is only available on Linux";
+}
+
+#endif /* __linux__ */
@@ -0,0 +1,39 @@
+/*
+ * perfctr.h - prototypes for the routines in perfctr.c that count
+ *     hardware events (cycles, cache misses, ...) with perf_event_open
+ */
+
+/* The events we count, in the order they appear in a perfctr_t */
+enum {
+    PC_CYCLES,        /* cpu cycles */
+    PC_INSTRUCTIONS,  /* instructions retired */
+    PC_L1D_MISSES,    /* L1 data cache read misses */
+    PC_LLC_MISSES,    /* last level cache misses */
+    PC_DTLB_MISSES,   /* data TLB read misses */
+    PC_BRANCH_MISSES, /* mispredicted branches */
+    PC_NUM
+};
+
+/* Counts for one measurement; -1 if that event couldn't be counted */
+typedef struct {
+    double count[PC_NUM];
+} perfctr_t;
+
+/* Open the counters. Returns how many of them are available (0 if 
+   none are, e.g. because of perf_event_paranoid or no PMU) */
+int perfctr_init(void);
+
+/* Close the counters */
+void perfctr_deinit(void);
+
+/* Reset and start the counters */
+void perfctr_start(void);
+
+/* Stop the counters and store their counts in *pc */
+void perfctr_stop(perfctr_t *pc);
+
+/* Short name of event i, for table headings */
+const char *perfctr_name(int i);
+
+/* Why perfctr_init found no counters */
+const char *perfctr_error(void);
@@ -0,0 +1,161 @@
+/*
+ * poolbench.c - Compare the throughput of mm_pool_alloc/mm_pool_free
+ *     with mm_malloc/mm_free on objects of one size.
+ *
+ * For each size, fill a working set of live objects, then free a random
+ * one and allocate a new one in its place, many times over: the churn of
+ * tree nodes or queue entries. Each allocator runs on a fresh heap, the
+ * fastest of RUNS runs is kept, and the random slots are drawn before
+ * the clock starts. Reports millions of free+alloc pairs per second and
+ * the heap each allocator needed.
+ *
+ *   unix> poolbench
+ *   unix> poolbench -n 2000000 -w 10000 24 40
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define RUNS 3   /* keep the fastest of this many runs */
+
+/* Function prototypes */
+static double run(size_t size, int pool, int *slots, int n, int w,
+		  mm_heapstat_t *st);
+static double mono_secs(void);
+static void usage(void);
+
+int main(int argc, char **argv)
+{
+    static size_t default_sizes[] = {16, 32, 64, 128, 256};
+    size_t size;
+    int n = 1000000, w = 4096;
+    int *slots, i, k, nsizes;
+    double t_malloc, t_pool;
+    mm_heapstat_t st_malloc, st_pool;
+    int c;
+
+    while ((c = getopt(argc, argv, "n:w:h")) != EOF) {
+	switch (c) {
+	case 'n': /* Free+alloc pairs per run */
+	    n = atoi(optarg);
+	    break;
+	case 'w': /* Live objects */
+	    w = atoi(optarg);
+	    break;
+	case 'h':
+	default:
+	    usage();
+	}
+    }
+    if (n <= 0 || w <= 0)
+	usage();
+    nsizes = (optind < argc) ? argc - optind : 5;
+
+    if ((slots = malloc(n * sizeof(int))) == NULL) {
+	perror("malloc");
+	exit(1);
+    }
+    srand(1);
+    for (i = 0; i < n; i++)
+	slots[i] = rand() % w;
+
+    mem_init();
+    printf("%d free+alloc pairs on %d live objects, best of %d runs\n", n, w, RUNS);
+    printf("%6s %12s %12s %8s %14s %14s %10s\n", "size", "malloc Mops",
+	   "pool Mops", "speedup", "malloc heap KB", "pool heap KB", "pool used");
+    for (k = 0; k < nsizes; k++) {
+	size = (optind < argc) ? (size_t)atoi(argv[optind+k]) : default_sizes[k];
+	if (size == 0)
+	    usage();
+	t_malloc = run(size, 0, slots, n, w, &st_malloc);
+	t_pool = run(size, 1, slots, n, w, &st_pool);
+	if (t_malloc < 0 || t_pool < 0) {
+	    printf("%6lu: out of heap\n", (unsigned long)size);
+	    continue;
+	}
+	printf("%6lu %12.2f %12.2f %7.2fx %14.1f %14.1f %9.0f%%\n",
+	       (unsigned long)size, n / t_malloc / 1e6, n / t_pool / 1e6,
+	       t_malloc / t_pool, st_malloc.heap_bytes / 1024.0,
+	       st_pool.heap_bytes / 1024.0,
+	       100.0 * st_pool.pool_used / st_pool.pool_bytes);
+    }
+    mem_deinit();
+    free(slots);
+    exit(0);
+}
+
+/*
+ * run - Churn w live objects of one size n times, with a pool or with
+ *     mm_malloc, and return the seconds of the fastest run, or -1 if the
+ *     heap ran out. *st gets the heap statistics at the end of the run.
+ */
+static double run(size_t size, int pool, int *slots, int n, int w,
+		  mm_heapstat_t *st)
+{
+    void **live;
+    mm_pool_t *p = NULL;
+    double start, secs, best = -1;
+    int r, i;
+
+    if ((live = malloc(w * sizeof(void *))) == NULL) {
+	perror("malloc");
+	exit(1);
+    }
+    for (r = 0; r < RUNS; r++) {
+	mem_reset_brk();
+	if (mm_init() < 0 || (pool && (p = mm_pool_create(size)) == NULL))
+	    goto out_of_heap;
+	for (i = 0; i < w; i++)
+	    if ((live[i] = pool ? mm_pool_alloc(p) : mm_malloc(size)) == NULL)
+		goto out_of_heap;
+
+	start = mono_secs();
+	if (pool) {
+	    for (i = 0; i < n; i++) {
+		mm_pool_free(p, live[slots[i]]);
+		if ((live[slots[i]] = mm_pool_alloc(p)) == NULL)
+		    goto out_of_heap;
+	    }
+	}
+	else {
+	    for (i = 0; i < n; i++) {
+		mm_free(live[slots[i]]);
+		if ((live[slots[i]] = mm_malloc(size)) == NULL)
+		    goto out_of_heap;
+	    }
+	}
+	secs = mono_secs() - start;
+	if (best < 0 || secs < best)
+	    best = secs;
+	mm_heapstat(st);
+    }
+    free(live);
+    return best;
+
+ out_of_heap:
+    free(live);
+    return -1;
+}
+
+static double mono_secs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: poolbench [-h] [-n <pairs>] [-w <live>] [<size> ...]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-n <pairs> Free+alloc pairs per run (default 1000000).\n");
+    fprintf(stderr, "\t-w <live>  Live objects (default 4096).\n");
+    fprintf(stderr, "\t<size>     Object sizes (default 16 32 64 128 256).\n");
+    exit(1);
+}
@@ -0,0 +1,27 @@
+/*
+ * tracefmt.h - binary trace file format, read by mdriver and written
+ *     by traces/gentrace. mdriver tells the two formats apart by the
+ *     magic string at the start of the file.
+ *
+ * A binary trace has the same header fields as a text trace (see
+ * traces/README), as 32-bit words after an 8-byte magic string,
+ * followed by num_ops records, all in the byte order of the machine
+ * that wrote them.
+ */
+
+#define TRACE_MAGIC "MMTRACE1" /* 8 bytes, no terminating null */
+
+typedef struct {
+    char magic[8];              /* TRACE_MAGIC */
+    unsigned int sugg_heapsize; /* suggested heap size (unused) */
+    unsigned int num_ids;       /* number of request ids */
+    unsigned int num_ops;       /* number of requests */
+    unsigned int weight;        /* weight for this trace (unused) */
+} tracefmt_hdr_t;
+
+typedef struct {
+    unsigned int type;  /* 'a', 'r', 'f', 'n', 'b', 'x' or 'd', as in a text trace */
+    unsigned int id;    /* request id (the region id for 'n', 'x' and 'd') */
+    unsigned int size;  /* bytes for 'a', 'r' and 'b', else 0 */
+    unsigned int extra; /* the region id for 'b', the call site for 'a' (0 = none) */
+} tracefmt_rec_t;
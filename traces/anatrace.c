@@ -0,0 +1,383 @@
+/*
+ * anatrace.c - Report what a trace does, to help tune size classes and
+ *     CHUNKSIZE: the request size histogram and the most common sizes,
+ *     object lifetimes in ops, realloc growth chains, and peak and
+ *     average live bytes. Objects allocated from a region live until
+ *     the region is reset or destroyed.
+ *
+ * Reads traces in the text (traces/README) or binary (../tracefmt.h)
+ * format in one pass. Memory is proportional to the number of request
+ * ids in the trace header, not to the number of ops, so it handles
+ * traces of hundreds of millions of ops.
+ *
+ *   unix> anatrace amptjp-bal.rep binary-bal.rep
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../tracefmt.h"
+
+#define MAXLINE  1024
+#define NBUCKETS 33      /* log2 buckets: k holds values in [2^(k-1), 2^k) */
+#define NEXACT   65536   /* exact counts for sizes below this */
+#define NTOP     10      /* most common sizes to report */
+
+/* What we remember about one request id while it is live */
+typedef struct {
+    unsigned long birth;  /* op index of the malloc */
+    unsigned size;        /* current size */
+    unsigned first;       /* size at the malloc */
+    unsigned reallocs;    /* reallocs so far */
+    int live;
+    int rnext;            /* id allocated before it in its region */
+} obj_t;
+
+/* A log2 histogram of counts and of the sum of the values */
+typedef struct {
+    unsigned long count[NBUCKETS];
+    double sum[NBUCKETS];
+    unsigned long n;
+    double total;
+} hist_t;
+
+/* Function prototypes */
+static void analyze(char *path);
+static int next_op(FILE *fp, int binary, int *type, unsigned *id, unsigned *size,
+		   unsigned *region);
+static void add(hist_t *h, double v);
+static int bucket(double v);
+static void print_hist(char *title, char *unit, hist_t *h, int sums);
+static void print_top(unsigned long *exact, unsigned long n);
+static void usage(void);
+
+int main(int argc, char **argv)
+{
+    char c;
+    int i;
+
+    while ((c = getopt(argc, argv, "h")) != EOF) {
+	switch (c) {
+	case 'h':
+	default:
+	    usage();
+	}
+    }
+    if (optind == argc)
+	usage();
+    for (i = optind; i < argc; i++)
+	analyze(argv[i]);
+    exit(0);
+}
+
+/*
+ * analyze - Read one trace and print its report
+ */
+static void analyze(char *path)
+{
+    FILE *fp;
+    tracefmt_hdr_t hdr;
+    int binary, type;
+    unsigned num_ids, num_ops, id, size, region;
+    unsigned long op = 0, peak_op = 0, exact_n = 0;
+    unsigned long allocs = 0, reallocs = 0, frees = 0, leaked = 0;
+    unsigned long regions = 0, region_allocs = 0, resets = 0;
+    unsigned long *exact;
+    int *rhead = NULL;    /* newest id allocated in each region */
+    int j;
+    double live = 0, peak = 0, live_sum = 0, live_objs = 0, peak_objs = 0;
+    hist_t sizes, lifetimes, chains, growth;
+    obj_t *objs, *o;
+
+    if ((fp = fopen(path, "rb")) == NULL) {
+	perror(path);
+	exit(1);
+    }
+    binary = (fread(&hdr, sizeof(hdr), 1, fp) == 1 &&
+	      memcmp(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic)) == 0);
+    if (binary) {
+	num_ids = hdr.num_ids;
+	num_ops = hdr.num_ops;
+    }
+    else {
+	rewind(fp);
+	if (fscanf(fp, "%*d %u %u %*d", &num_ids, &num_ops) != 2) {
+	    fprintf(stderr, "%s: bad trace header\n", path);
+	    exit(1);
+	}
+    }
+
+    if ((objs = calloc(num_ids, sizeof(obj_t))) == NULL ||
+	(exact = calloc(NEXACT, sizeof(unsigned long))) == NULL) {
+	perror("calloc");
+	exit(1);
+    }
+    memset(&sizes, 0, sizeof(hist_t));
+    memset(&lifetimes, 0, sizeof(hist_t));
+    memset(&chains, 0, sizeof(hist_t));
+    memset(&growth, 0, sizeof(hist_t));
+
+    while (next_op(fp, binary, &type, &id, &size, &region)) {
+	if (id >= num_ids || region >= num_ids) {
+	    fprintf(stderr, "%s: op %lu: id %u out of range\n", path, op, 
+		    id >= num_ids ? id : region);
+	    exit(1);
+	}
+	o = &objs[id];
+
+	switch (type) {
+	case 'n':
+	    regions++;
+	    if (rhead == NULL && (rhead = malloc(num_ids * sizeof(int))) == NULL) {
+		perror("malloc");
+		exit(1);
+	    }
+	    rhead[region] = -1;
+	    break;
+
+	case 'x':
+	case 'd':
+	    /* Every object of the region dies here */
+	    resets += (type == 'x');
+	    for (j = rhead[region]; j >= 0; j = objs[j].rnext) {
+		live -= objs[j].size;
+		live_objs--;
+		add(&lifetimes, op - objs[j].birth);
+		objs[j].live = 0;
+	    }
+	    rhead[region] = -1;
+	    break;
+
+	case 'b':
+	    region_allocs++;
+	    o->rnext = rhead[region];
+	    rhead[region] = id;
+	    /* fall through */
+	case 'a':
+	    allocs++;
+	    o->birth = op;
+	    o->size = o->first = size;
+	    o->reallocs = 0;
+	    o->live = 1;
+	    live += size;
+	    live_objs++;
+	    add(&sizes, size);
+	    if (size < NEXACT)
+		exact[size]++;
+	    exact_n++;
+	    break;
+
+	case 'r':
+	    reallocs++;
+	    live += (double)size - o->size;
+	    o->size = size;
+	    o->reallocs++;
+	    add(&sizes, size);
+	    if (size < NEXACT)
+		exact[size]++;
+	    exact_n++;
+	    break;
+
+	case 'f':
+	    frees++;
+	    live -= o->size;
+	    live_objs--;
+	    add(&lifetimes, op - o->birth);
+	    if (o->reallocs > 0) {
+		add(&chains, o->reallocs);
+		add(&growth, o->first ?
+		    (double)o->size / o->first : (double)o->size);
+	    }
+	    o->live = 0;
+	    break;
+	}
+
+	if (live > peak) {
+	    peak = live;
+	    peak_op = op;
+	}
+	if (live_objs > peak_objs)
+	    peak_objs = live_objs;
+	live_sum += live;
+	op++;
+    }
+    fclose(fp);
+
+    /* Objects that are never freed count as living to the end */
+    for (id = 0; id < num_ids; id++)
+	if (objs[id].live) {
+	    leaked++;
+	    add(&lifetimes, op - objs[id].birth);
+	}
+
+    printf("%s: %lu ops (%lu malloc, %lu realloc, %lu free), %u ids\n",
+	   path, op, allocs, reallocs, frees, num_ids);
+    if (regions > 0)
+	printf("  %lu regions: %lu of the mallocs are from regions, %lu resets\n",
+	       regions, region_allocs, resets);
+    if (op != num_ops)
+	printf("  warning: the header says %u ops\n", num_ops);
+    if (leaked > 0)
+	printf("  warning: %lu objects are never freed\n", leaked);
+    printf("  peak live bytes %.0f at op %lu, average %.0f, "
+	   "peak live objects %.0f\n", peak, peak_op,
+	   op ? live_sum / op : 0, peak_objs);
+    printf("  mean request %.1f bytes, mean lifetime %.1f ops\n",
+	   sizes.n ? sizes.total / sizes.n : 0,
+	   lifetimes.n ? lifetimes.total / lifetimes.n : 0);
+
+    print_hist("request sizes (malloc and realloc)", "bytes", &sizes, 1);
+    print_top(exact, exact_n);
+    print_hist("lifetimes", "ops", &lifetimes, 0);
+    if (chains.n > 0) {
+	print_hist("reallocs per reallocated object", "reallocs", &chains, 0);
+	print_hist("final size / first size of reallocated objects",
+		   "ratio", &growth, 0);
+    }
+    printf("\n");
+
+    free(objs);
+    free(exact);
+    free(rhead);
+}
+
+/*
+ * next_op - Read the next request of a trace. Returns 0 at the end.
+ *     The region of a region request is in *region, and is 0 for
+ *     other requests.
+ */
+static int next_op(FILE *fp, int binary, int *type, unsigned *id, unsigned *size,
+		   unsigned *region)
+{
+    static tracefmt_rec_t rec[4096];
+    static int nrec = 0, next = 0;
+    char line[MAXLINE], *p;
+
+    if (binary) {
+	if (next == nrec) {
+	    nrec = fread(rec, sizeof(tracefmt_rec_t), 4096, fp);
+	    next = 0;
+	    if (nrec == 0)
+		return 0;
+	}
+	*type = rec[next].type;
+	*id = rec[next].id;
+	*size = rec[next].size;
+	*region = (*type == 'b') ? rec[next].extra : 
+	    (*type == 'n' || *type == 'x' || *type == 'd') ? rec[next].id : 0;
+	next++;
+	return 1;
+    }
+
+    /* Skip blank lines; parse by hand, which is much faster than fscanf */
+    do {
+	if (fgets(line, MAXLINE, fp) == NULL)
+	    return 0;
+	p = line + strspn(line, " \t");
+    } while (*p == '\n' || *p == '\0');
+
+    *type = *p++;
+    *region = 0;
+    if (*type == 'b')
+	*region = strtoul(p, &p, 10);
+    *id = strtoul(p, &p, 10);
+    if (*type == 'n' || *type == 'x' || *type == 'd')
+	*region = *id;
+    *size = (*type == 'a' || *type == 'r' || *type == 'b') ? strtoul(p, &p, 10) : 0;
+    if (strchr("arfbnxd", *type) == NULL) {
+	fprintf(stderr, "Bogus request type (%c) in trace\n", *type);
+	exit(1);
+    }
+    return 1;
+}
+
+/*
+ * add - Add a value to a log2 histogram
+ */
+static void add(hist_t *h, double v)
+{
+    int k = bucket(v);
+
+    h->count[k]++;
+    h->sum[k] += v;
+    h->n++;
+    h->total += v;
+}
+
+/* bucket - k such that 2^(k-1) <= v < 2^k, with 0 for v < 1 */
+static int bucket(double v)
+{
+    int k = 0;
+
+    while (k < NBUCKETS-1 && v >= (double)(1UL << k))
+	k++;
+    return k;
+}
+
+/*
+ * print_hist - Print the non-empty buckets of a histogram with their
+ *     share of the values and, if sums is set, of the sum of the values
+ */
+static void print_hist(char *title, char *unit, hist_t *h, int sums)
+{
+    double cum = 0;
+    int k;
+
+    printf("  %s:\n", title);
+    printf("    %10s %-10s %12s %7s %7s", unit, "", "count", "%", "cum%");
+    if (sums)
+	printf(" %7s", "%sum");
+    printf("\n");
+    for (k = 0; k < NBUCKETS; k++) {
+	if (h->count[k] == 0)
+	    continue;
+	cum += h->count[k];
+	if (k == 0)
+	    printf("    %10s %-10s", "0", "");
+	else
+	    printf("    %10lu-%-10lu", 1UL << (k-1), (1UL << k) - 1);
+	printf(" %12lu %6.2f%% %6.2f%%", h->count[k],
+	       100.0 * h->count[k] / h->n, 100.0 * cum / h->n);
+	if (sums)
+	    printf(" %6.2f%%", h->total > 0 ? 100.0 * h->sum[k] / h->total : 0);
+	printf("\n");
+    }
+}
+
+/*
+ * print_top - Print the most common request sizes
+ */
+static void print_top(unsigned long *exact, unsigned long n)
+{
+    unsigned top[NTOP];
+    int i, j, ntop = 0;
+    unsigned s;
+
+    /* Insertion into a short sorted list */
+    for (s = 0; s < NEXACT; s++) {
+	if (exact[s] == 0)
+	    continue;
+	for (i = ntop; i > 0 && exact[top[i-1]] < exact[s]; i--)
+	    if (i < NTOP)
+		top[i] = top[i-1];
+	if (i < NTOP) {
+	    top[i] = s;
+	    if (ntop < NTOP)
+		ntop++;
+	}
+    }
+
+    printf("  most common sizes:");
+    for (j = 0; j < ntop; j++)
+	printf(" %u (%.1f%%)", top[j], 100.0 * exact[top[j]] / n);
+    printf("\n");
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: anatrace [-h] <tracefile> ...\n");
+    fprintf(stderr, "Report the request sizes, lifetimes, realloc chains and live bytes\n");
+    fprintf(stderr, "of each trace, in the text or binary trace format.\n");
+    exit(1);
+}
@@ -49,6 +49,12 @@ $summary = $opt_s;
 #
 %HASH = (); 
 
+#
+# REGION holds the live regions (n without d), each with the list of
+# ids allocated from it (b) since it was created or last reset (x).
+#
+%REGION = ();
+
 # Read the trace header values
 $heap_size = <STDIN>;
 chomp($heap_size);
@@ -81,6 +87,42 @@ while ($line = <STDIN>) {
     # save the line for output later
     $lines[$requestnum++] = $line;
 
+    # region requests: n <rid>, b <rid> <id> <size>, x <rid>, d <rid>
+    if ($cmd eq "n") {
+	if (exists($HASH{$id}) or exists($REGION{$id})) {
+	    die "$0: ERROR[$linenum]: region id $id is in use.\n";
+	}
+	$REGION{$id} = [];
+	next;
+    }
+    if ($cmd eq "b" or $cmd eq "x" or $cmd eq "d") {
+	if (!exists($REGION{$id})) {
+	    die "$0: ERROR[$linenum]: no region $id.\n";
+	}
+    }
+    if ($cmd eq "b") {
+	($cmd, $rid, $id, $size) = split(" ", $line);
+	if (exists($HASH{$id}) or exists($REGION{$id})) {
+	    die "$0: ERROR[$linenum]: allocate with no intervening free.\n";
+	}
+	$HASH{$id} = "b";
+	push @{$REGION{$rid}}, $id;
+	next;
+    }
+    if ($cmd eq "x" or $cmd eq "d") {
+	foreach $bid (@{$REGION{$id}}) {
+	    delete $HASH{$bid};
+	}
+	$REGION{$id} = [];
+	if ($cmd eq "d") {
+	    delete $REGION{$id};
+	}
+	next;
+    }
+    if ($HASH{$id} eq "b") {
+	die "$0: ERROR[$linenum]: region block passed to $cmd.\n";
+    }
+
     #ignore realloc requests, as long as they are preceeded by an alloc request
     if ($cmd eq "r") {
 	if (!$HASH{$id}) {
@@ -119,7 +161,7 @@ while ($line = <STDIN>) {
 # If called with -s argument , print a brief balance summary and exit
 #
 if ($summary) {
-    if (!%HASH) {
+    if (!%HASH and !%REGION) {
 	print "Balanced trace.\n";
     } 
     else {
@@ -131,7 +173,13 @@ if ($summary) {
 #
 # Output a balanced version of the trace
 #
-$new_ops = keys %HASH;
+# region blocks go away with their region
+foreach $key (keys %HASH) {
+    if ($HASH{$key} eq "b") {
+	delete $HASH{$key};
+    }
+}
+$new_ops = (keys %HASH) + (keys %REGION);
 $new_num_ops = $old_num_ops + $new_ops;
 
 print "$heap_size\n";
@@ -151,5 +199,8 @@ foreach $key (sort keys %HASH) {
     }
     print "f $key\n";
 }
+foreach $key (sort keys %REGION) {
+    print "d $key\n";
+}
 
 exit;
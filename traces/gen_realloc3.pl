@@ -0,0 +1,58 @@
+#!/usr/bin/perl
+#!/usr/local/bin/perl
+
+# Several buffers grown in turns, like string builders or vectors
+# appended to by interleaved requests. Each step grows one buffer by a
+# random amount and mallocs a small short-lived object, so the
+# neighbours of a buffer are usually taken when it next grows. Once in
+# a while a buffer is cut back to its first size, as after a clear.
+
+$out_filename = "realloc3.rep";
+$num_bufs = 8;
+$num_iters = 4000;
+$first_size = 64;
+$max_step = 200;
+$malloc_size = 32;
+$shrink_odds = 500;
+
+srand(1);
+
+@lines = ();
+@size = ();
+$peak = 0;
+
+for ($b = 0; $b < $num_bufs; $b++) {
+    $size[$b] = $first_size;
+    push @lines, "a $b $first_size";
+}
+$id = $num_bufs;
+
+for ($i = 0; $i < $num_iters; $i++) {
+    $b = $i % $num_bufs;
+    if (int(rand($shrink_odds)) == 0) {
+        $size[$b] = $first_size;
+    } else {
+        $size[$b] += 1 + int(rand($max_step));
+    }
+    push @lines, "r $b $size[$b]";
+    push @lines, "a $id $malloc_size";
+    push @lines, "f " . ($id - 1) if $id > $num_bufs;
+    $id++;
+    $total = 0;
+    $total += $_ foreach @size;
+    $peak = $total if $total > $peak;
+}
+push @lines, "f " . ($id - 1);
+for ($b = 0; $b < $num_bufs; $b++) {
+    push @lines, "f $b";
+}
+
+open OUTFILE, ">$out_filename" or die "Cannot create $out_filename\n";
+print OUTFILE $peak + 2*$malloc_size, "\n";
+print OUTFILE "$id\n";
+print OUTFILE scalar(@lines), "\n";
+print OUTFILE "1\n";
+foreach $line (@lines) {
+    print OUTFILE "$line\n";
+}
+close OUTFILE;
@@ -0,0 +1,98 @@
+#!/usr/bin/perl
+#!/usr/local/bin/perl
+
+# Request handlers: each request allocates many short-lived objects
+# and drops them all when it ends. $inflight requests are served at a
+# time, each from its own region that is reset when the next request
+# starts in it. Each request also mallocs one longer-lived cache entry,
+# freed $cache requests later. region.rep uses the region requests;
+# region-malloc.rep is the same workload with one malloc and one free
+# per object, to compare against.
+
+$num_reqs = 400;
+$inflight = 4;
+$cache = 50;
+$min_objs = 20;
+$max_objs = 120;
+$min_size = 8;
+$max_size = 256;
+$big_size = 3000;       # one object in $big_odds is up to this big
+$big_odds = 50;
+
+srand(1);
+
+@region = ();
+@plain = ();
+$id = $inflight;        # ids 0 .. $inflight-1 are the regions
+@objs = ();             # objects of the request in each region
+@entries = ();          # cache entries, oldest first
+
+for ($r = 0; $r < $inflight; $r++) {
+    push @region, "n $r";
+}
+
+for ($q = 0; $q < $num_reqs; $q++) {
+    $r = $q % $inflight;
+
+    # The previous request in this region is done
+    if ($q >= $inflight) {
+        push @region, "x $r";
+        foreach $o (@{$objs[$r]}) {
+            push @plain, "f $o";
+        }
+    }
+    $objs[$r] = [];
+
+    $n = $min_objs + int(rand($max_objs - $min_objs + 1));
+    for ($i = 0; $i < $n; $i++) {
+        $size = $min_size + int(rand($max_size - $min_size + 1));
+        if (int(rand($big_odds)) == 0) {
+            $size = $max_size + int(rand($big_size - $max_size + 1));
+        }
+        push @region, "b $r $id $size";
+        push @plain, "a $id $size";
+        push @{$objs[$r]}, $id;
+        $id++;
+    }
+
+    $size = 64 + int(rand(449));
+    push @region, "a $id $size";
+    push @plain, "a $id $size";
+    push @entries, $id;
+    $id++;
+    if (@entries > $cache) {
+        $o = shift @entries;
+        push @region, "f $o";
+        push @plain, "f $o";
+    }
+}
+
+for ($r = 0; $r < $inflight; $r++) {
+    push @region, "d $r";
+    foreach $o (@{$objs[$r]}) {
+        push @plain, "f $o";
+    }
+}
+foreach $o (@entries) {
+    push @region, "f $o";
+    push @plain, "f $o";
+}
+
+write_trace("region.rep", @region);
+write_trace("region-malloc.rep", @plain);
+
+sub write_trace
+{
+    my ($out_filename, @lines) = @_;
+    my $num_ops = @lines;
+
+    open OUTFILE, ">$out_filename" or die "Cannot create $out_filename\n";
+    print OUTFILE $inflight*$max_objs*$max_size + $cache*512, "\n";
+    print OUTFILE "$id\n";
+    print OUTFILE "$num_ops\n";
+    print OUTFILE "1\n";
+    foreach $line (@lines) {
+        print OUTFILE "$line\n";
+    }
+    close OUTFILE;
+}
@@ -0,0 +1,41 @@
+#!/usr/bin/perl
+#!/usr/local/bin/perl
+
+# Producer/consumer queue: each message is allocated, waits in a FIFO
+# queue of $depth messages, and is then freed. Replayed with mdriver
+# -T <n> -X, every message is freed by another thread than the one
+# that allocated it.
+
+$out_filename = "xfree.rep";
+$num_msgs = 6000;
+$depth = 64;
+$min_size = 16;
+$max_size = 512;
+
+srand(1);
+
+# Open output file
+open OUTFILE, ">$out_filename" or die "Cannot create $out_filename\n";
+
+# Calculate misc parameters
+$suggested_heap_size = ($depth + 1)*$max_size + 100;
+$num_ops = 2*$num_msgs;
+
+print OUTFILE "$suggested_heap_size\n";
+print OUTFILE "$num_msgs\n";
+print OUTFILE "$num_ops\n";
+print OUTFILE "1\n";
+
+for ($i = 0;  $i < $num_msgs; $i += 1) {
+    $size = $min_size + int(rand($max_size - $min_size + 1));
+    print OUTFILE "a $i $size\n";
+    if ($i >= $depth) {
+        $fseq = $i - $depth;
+        print OUTFILE "f $fseq\n";
+    }
+}
+for ($i = $num_msgs - $depth;  $i < $num_msgs; $i += 1) {
+    print OUTFILE "f $i\n";
+}
+
+close OUTFILE;
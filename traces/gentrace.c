@@ -0,0 +1,571 @@
+/*
+ * gentrace.c - Parametric synthetic trace generator.
+ *
+ * Writes a balanced trace in the text format (traces/README), the binary
+ * format (../tracefmt.h), or both. The trace is a sequence of phases.
+ * Each phase runs for a number of ops and has its own request size
+ * distribution, object lifetime distribution, and realloc growth
+ * pattern; -p starts a new phase that inherits the settings of the
+ * previous one. At the end, every object that is still live is freed
+ * in the order it would have died.
+ *
+ * Lifetimes are counted in allocations: an object with lifetime L is
+ * freed once L more objects have been allocated after it. So with a
+ * mean lifetime of L, about L objects are live in the steady state.
+ *
+ * With -c, every allocation carries the number of its phase (from 1)
+ * as its call site, so mdriver --sites can tell the phases apart.
+ *
+ * The same seed and options always give the same trace. The generator
+ * streams its output, with memory proportional to the number of live
+ * objects, so it can write traces of hundreds of millions of ops.
+ *
+ * Examples:
+ *   unix> gentrace -o zipf -n 1000000 -S zipf:1.1:4096 -L exp:2000
+ *   unix> gentrace -o phases -n 50000 -S uniform:16:64 -L fixed:100 \
+ *                  -p -n 50000 -S bimodal:64:448:0.8 -R 0.05:mul:1.5
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "../tracefmt.h"
+
+#define MAXLINE   1024
+#define MAXPHASES 64
+#define BUFRECS   4096   /* binary records buffered per write */
+
+/* A distribution of positive integers (sizes or lifetimes) */
+typedef struct {
+    enum {FIXED, UNIFORM, EXP, ZIPF, BIMODAL, HIST} kind;
+    double a, b, c;    /* parameters, depending on kind */
+    int n;             /* ZIPF, HIST: number of table entries */
+    double *cdf;       /* ZIPF, HIST: cumulative probabilities */
+    unsigned *val;     /* ZIPF, HIST: the value of each entry */
+} dist_t;
+
+/* Realloc growth: with probability prob, grow a random live object */
+typedef struct {
+    double prob;       /* per-op probability of a realloc (0 = none) */
+    int add;           /* grow by adding amount instead of multiplying */
+    double amount;     /* the growth factor or increment */
+} grow_t;
+
+/* One phase of the trace */
+typedef struct {
+    unsigned long ops; /* number of ops in this phase */
+    dist_t size;       /* request sizes */
+    dist_t life;       /* lifetimes, in allocations */
+    grow_t grow;       /* realloc growth pattern */
+} phase_t;
+
+/* A live object, kept in a heap ordered by the time it dies */
+typedef struct {
+    unsigned long long death; /* allocation clock at which it is freed */
+    unsigned id;
+    unsigned size;
+} obj_t;
+
+/* Globals */
+static unsigned long long rng;      /* PRNG state */
+static unsigned max_size = 1 << 20; /* largest request size (-m) */
+static unsigned site = 0;           /* call site of allocations (-c), 0 = none */
+
+static obj_t *live = NULL;          /* heap of live objects */
+static unsigned nlive = 0, max_live = 0;
+static unsigned *free_ids = NULL;   /* ids that can be reused */
+static unsigned nfree_ids = 0, num_ids = 0;
+static unsigned long long now = 0;  /* allocations so far */
+static unsigned long num_ops = 0;
+static unsigned long long live_bytes = 0, peak_bytes = 0;
+
+static FILE *text = NULL, *bin = NULL;
+static tracefmt_rec_t recbuf[BUFRECS];
+static int nrecs = 0;
+
+/* Function prototypes */
+static unsigned long long next_rand(void);
+static double rand_double(void);
+static void parse_dist(char *spec, dist_t *d);
+static void parse_grow(char *spec, grow_t *g);
+static void make_zipf(dist_t *d);
+static void read_hist(char *file, dist_t *d);
+static unsigned sample(dist_t *d);
+static void step(phase_t *ph);
+static void push(obj_t o);
+static obj_t pop(void);
+static void emit(int type, unsigned id, unsigned size);
+static void write_headers(unsigned heapsize);
+static void usage(void);
+static void fatal(char *msg);
+
+int main(int argc, char **argv)
+{
+    phase_t phases[MAXPHASES];
+    int nphases = 1, i;
+    char name[MAXLINE] = "gen";
+    char path[MAXLINE];
+    int do_text = 1, do_bin = 1, sites = 0;
+    unsigned long k;
+    obj_t o;
+    char c;
+
+    rng = 1;
+    memset(phases, 0, sizeof(phases));
+    phases[0].ops = 100000;
+    parse_dist("uniform:1:4096", &phases[0].size);
+    parse_dist("exp:1000", &phases[0].life);
+
+    while ((c = getopt(argc, argv, "ho:f:s:m:cn:S:L:R:p")) != EOF) {
+	switch (c) {
+	case 'o': /* Output name, without the extension */
+	    strcpy(name, optarg);
+	    break;
+	case 'f': /* Output format */
+	    do_text = !strcmp(optarg, "rep") || !strcmp(optarg, "both");
+	    do_bin = !strcmp(optarg, "bin") || !strcmp(optarg, "both");
+	    if (!do_text && !do_bin)
+		usage();
+	    break;
+	case 's': /* PRNG seed; xorshift stays at 0 forever from 0 */
+	    if ((rng = strtoull(optarg, NULL, 0)) == 0)
+		usage();
+	    break;
+	case 'm': /* Largest request size */
+	    max_size = atoi(optarg);
+	    break;
+	case 'c': /* Give each phase's allocations its own call site */
+	    sites = 1;
+	    break;
+	case 'n': /* Ops in this phase */
+	    phases[nphases-1].ops = strtoul(optarg, NULL, 0);
+	    break;
+	case 'S': /* Size distribution of this phase */
+	    parse_dist(optarg, &phases[nphases-1].size);
+	    break;
+	case 'L': /* Lifetime distribution of this phase */
+	    parse_dist(optarg, &phases[nphases-1].life);
+	    break;
+	case 'R': /* Realloc growth pattern of this phase */
+	    parse_grow(optarg, &phases[nphases-1].grow);
+	    break;
+	case 'p': /* Start a new phase */
+	    if (nphases == MAXPHASES)
+		fatal("too many phases");
+	    phases[nphases] = phases[nphases-1];
+	    nphases++;
+	    break;
+	case 'h':
+	default:
+	    usage();
+	}
+    }
+    if (max_size < 1)
+	usage();
+
+    /* Open the outputs; the headers are rewritten once we know the counts */
+    if (do_text) {
+	sprintf(path, "%s.rep", name);
+	if ((text = fopen(path, "w")) == NULL)
+	    fatal(path);
+	setvbuf(text, NULL, _IOFBF, 1 << 20);
+    }
+    if (do_bin) {
+	sprintf(path, "%s.bin", name);
+	if ((bin = fopen(path, "wb")) == NULL)
+	    fatal(path);
+    }
+    write_headers(0);
+
+    for (i = 0; i < nphases; i++) {
+	site = sites ? i + 1 : 0;
+	for (k = 0; k < phases[i].ops; k++)
+	    step(&phases[i]);
+    }
+
+    /* Balance the trace */
+    while (nlive > 0) {
+	o = pop();
+	emit('f', o.id, 0);
+	free_ids[nfree_ids++] = o.id;
+    }
+
+    if (bin && nrecs > 0 && fwrite(recbuf, sizeof(tracefmt_rec_t), nrecs, bin) != nrecs)
+	fatal("fwrite");
+    write_headers(peak_bytes > 0xffffffffULL ? 0xffffffffU : (unsigned)peak_bytes);
+    if ((text && fclose(text) != 0) || (bin && fclose(bin) != 0))
+	fatal("fclose");
+
+    printf("%s: %lu ops, %u ids, %u max live objects, %llu max live bytes\n",
+	   name, num_ops, num_ids, max_live, peak_bytes);
+    exit(0);
+}
+
+/*
+ * step - Emit one op of a phase: free the object that is due to die,
+ *     or else maybe grow a live object, or else allocate a new one
+ */
+static void step(phase_t *ph)
+{
+    obj_t o, *op;
+    double newsize;
+
+    if (nlive > 0 && live[0].death <= now) {
+	o = pop();
+	live_bytes -= o.size;
+	emit('f', o.id, 0);
+	free_ids[nfree_ids++] = o.id;
+	return;
+    }
+
+    if (nlive > 0 && ph->grow.prob > 0 && rand_double() < ph->grow.prob) {
+	op = &live[next_rand() % nlive]; /* heap order is by death only */
+	if (ph->grow.add)
+	    newsize = op->size + ph->grow.amount;
+	else
+	    newsize = op->size * ph->grow.amount;
+	if (newsize > max_size)
+	    newsize = max_size;
+	if (newsize < 1)
+	    newsize = 1;
+	live_bytes = live_bytes - op->size + (unsigned)newsize;
+	if (live_bytes > peak_bytes)
+	    peak_bytes = live_bytes;
+	op->size = (unsigned)newsize;
+	emit('r', op->id, op->size);
+	return;
+    }
+
+    o.size = sample(&ph->size);
+    if (o.size > max_size)
+	o.size = max_size;
+    if (o.size < 1)
+	o.size = 1;
+    o.id = (nfree_ids > 0) ? free_ids[--nfree_ids] : num_ids++;
+    o.death = now + sample(&ph->life);
+    now++;
+    live_bytes += o.size;
+    emit('a', o.id, o.size);
+    push(o);
+}
+
+/*
+ * next_rand - xorshift64* PRNG, so that a seed gives the same trace
+ *     with any libc
+ */
+static unsigned long long next_rand(void)
+{
+    rng ^= rng >> 12;
+    rng ^= rng << 25;
+    rng ^= rng >> 27;
+    return rng * 0x2545F4914F6CDD1DULL;
+}
+
+/* rand_double - uniform in [0, 1) */
+static double rand_double(void)
+{
+    return (next_rand() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/*
+ * sample - Draw a value from a distribution
+ */
+static unsigned sample(dist_t *d)
+{
+    double u, x = 0;
+    int lo, hi, mid;
+
+    switch (d->kind) {
+    case FIXED:
+	x = d->a;
+	break;
+    case UNIFORM:
+	x = d->a + (unsigned long long)(rand_double() * (d->b - d->a + 1));
+	break;
+    case EXP:
+	x = floor(-d->a * log(1.0 - rand_double()));
+	break;
+    case BIMODAL:
+	x = (rand_double() < d->c) ? d->a : d->b;
+	break;
+    case ZIPF:
+    case HIST:
+	/* Binary search for the first entry whose cdf exceeds u */
+	u = rand_double();
+	lo = 0;
+	hi = d->n - 1;
+	while (lo < hi) {
+	    mid = (lo + hi) / 2;
+	    if (d->cdf[mid] > u)
+		hi = mid;
+	    else
+		lo = mid + 1;
+	}
+	x = d->val[lo];
+	break;
+    }
+    if (x > 0xffffffffU)
+	x = 0xffffffffU;
+    return (unsigned)x;
+}
+
+/*
+ * parse_dist - Parse a distribution spec:
+ *     fixed:<n>               always n
+ *     uniform:<lo>:<hi>       uniform in [lo, hi]
+ *     exp:<mean>              exponential with the given mean
+ *     zipf:<s>:<n>[:<unit>]   k * unit with probability proportional
+ *                             to k^-s, for k in [1, n] (unit = 1)
+ *     bimodal:<a>:<b>:<p>     a with probability p, otherwise b
+ *     hist:<file>             empirical: "<value> <weight>" per line
+ */
+static void parse_dist(char *spec, dist_t *d)
+{
+    char kind[MAXLINE];
+    char *arg;
+
+    strcpy(kind, spec);
+    if ((arg = strchr(kind, ':')) == NULL)
+	usage();
+    *arg++ = '\0';
+
+    memset(d, 0, sizeof(*d));
+    d->c = 1;
+    if (!strcmp(kind, "fixed")) {
+	d->kind = FIXED;
+	if (sscanf(arg, "%lf", &d->a) != 1)
+	    usage();
+    }
+    else if (!strcmp(kind, "uniform")) {
+	d->kind = UNIFORM;
+	if (sscanf(arg, "%lf:%lf", &d->a, &d->b) != 2 || d->b < d->a)
+	    usage();
+    }
+    else if (!strcmp(kind, "exp")) {
+	d->kind = EXP;
+	if (sscanf(arg, "%lf", &d->a) != 1)
+	    usage();
+    }
+    else if (!strcmp(kind, "zipf")) {
+	d->kind = ZIPF;
+	if (sscanf(arg, "%lf:%d:%lf", &d->a, &d->n, &d->c) < 2 || d->n < 1)
+	    usage();
+	make_zipf(d);
+    }
+    else if (!strcmp(kind, "bimodal")) {
+	d->kind = BIMODAL;
+	if (sscanf(arg, "%lf:%lf:%lf", &d->a, &d->b, &d->c) != 3)
+	    usage();
+    }
+    else if (!strcmp(kind, "hist")) {
+	d->kind = HIST;
+	read_hist(arg, d);
+    }
+    else
+	usage();
+}
+
+/*
+ * parse_grow - Parse a realloc growth spec: <prob>:mul:<factor> or
+ *     <prob>:add:<bytes>
+ */
+static void parse_grow(char *spec, grow_t *g)
+{
+    char mode[MAXLINE];
+
+    if (sscanf(spec, "%lf:%[a-z]:%lf", &g->prob, mode, &g->amount) != 3)
+	usage();
+    if (!strcmp(mode, "add"))
+	g->add = 1;
+    else if (!strcmp(mode, "mul"))
+	g->add = 0;
+    else
+	usage();
+}
+
+/*
+ * make_zipf - Build the cumulative table of a Zipf distribution
+ */
+static void make_zipf(dist_t *d)
+{
+    double sum = 0;
+    int k;
+
+    if ((d->cdf = malloc(d->n * sizeof(double))) == NULL ||
+	(d->val = malloc(d->n * sizeof(unsigned))) == NULL)
+	fatal("malloc");
+    for (k = 0; k < d->n; k++) {
+	sum += pow(k + 1, -d->a);
+	d->cdf[k] = sum;
+	d->val[k] = (k + 1) * d->c;
+    }
+    for (k = 0; k < d->n; k++)
+	d->cdf[k] /= sum;
+}
+
+/*
+ * read_hist - Build the cumulative table of an empirical histogram
+ */
+static void read_hist(char *file, dist_t *d)
+{
+    FILE *fp;
+    unsigned value;
+    double weight, sum = 0;
+    int k;
+
+    if ((fp = fopen(file, "r")) == NULL)
+	fatal(file);
+    while (fscanf(fp, "%u %lf", &value, &weight) == 2) {
+	if (weight <= 0)
+	    continue;
+	if ((d->cdf = realloc(d->cdf, (d->n+1) * sizeof(double))) == NULL ||
+	    (d->val = realloc(d->val, (d->n+1) * sizeof(unsigned))) == NULL)
+	    fatal("realloc");
+	sum += weight;
+	d->cdf[d->n] = sum;
+	d->val[d->n] = value;
+	d->n++;
+    }
+    fclose(fp);
+    if (d->n == 0)
+	fatal("empty histogram");
+    for (k = 0; k < d->n; k++)
+	d->cdf[k] /= sum;
+}
+
+/*
+ * push, pop - The heap of live objects, smallest death time first
+ */
+static void push(obj_t o)
+{
+    static unsigned max = 0;
+    unsigned i, parent;
+
+    if (nlive == max) {
+	max = max ? 2 * max : 1024;
+	if ((live = realloc(live, max * sizeof(obj_t))) == NULL ||
+	    (free_ids = realloc(free_ids, max * sizeof(unsigned))) == NULL)
+	    fatal("realloc");
+    }
+    for (i = nlive++; i > 0; i = parent) {
+	parent = (i - 1) / 2;
+	if (live[parent].death <= o.death)
+	    break;
+	live[i] = live[parent];
+    }
+    live[i] = o;
+
+    if (nlive > max_live)
+	max_live = nlive;
+    if (live_bytes > peak_bytes)
+	peak_bytes = live_bytes;
+}
+
+static obj_t pop(void)
+{
+    obj_t top = live[0], last = live[--nlive];
+    unsigned i = 0, child;
+
+    while ((child = 2 * i + 1) < nlive) {
+	if (child + 1 < nlive && live[child+1].death < live[child].death)
+	    child++;
+	if (last.death <= live[child].death)
+	    break;
+	live[i] = live[child];
+	i = child;
+    }
+    live[i] = last;
+    return top;
+}
+
+/*
+ * emit - Write one op to the outputs
+ */
+static void emit(int type, unsigned id, unsigned size)
+{
+    num_ops++;
+    if (text) {
+	if (type == 'f')
+	    fprintf(text, "f %u\n", id);
+	else if (type == 'a' && site > 0)
+	    fprintf(text, "a %u %u %u\n", id, size, site);
+	else
+	    fprintf(text, "%c %u %u\n", type, id, size);
+    }
+    if (bin) {
+	recbuf[nrecs].type = type;
+	recbuf[nrecs].id = id;
+	recbuf[nrecs].size = size;
+	recbuf[nrecs].extra = (type == 'a') ? site : 0;
+	if (++nrecs == BUFRECS) {
+	    if (fwrite(recbuf, sizeof(tracefmt_rec_t), nrecs, bin) != nrecs)
+		fatal("fwrite");
+	    nrecs = 0;
+	}
+    }
+}
+
+/*
+ * write_headers - Write the trace headers at the start of the outputs.
+ *     The text header is padded to a fixed width so that it can be
+ *     rewritten in place when the counts are known.
+ */
+static void write_headers(unsigned heapsize)
+{
+    tracefmt_hdr_t hdr;
+
+    if (num_ops > 0x7fffffffUL)
+	fatal("too many ops for the trace format");
+    if (text) {
+	fflush(text);
+	rewind(text);
+	fprintf(text, "%-10u\n%-10u\n%-10lu\n%-10u\n", heapsize,
+		num_ids, num_ops, 1);
+	fflush(text);
+	fseek(text, 0, SEEK_END);
+    }
+    if (bin) {
+	memcpy(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic));
+	hdr.sugg_heapsize = heapsize;
+	hdr.num_ids = num_ids;
+	hdr.num_ops = num_ops;
+	hdr.weight = 1;
+	fflush(bin);
+	rewind(bin);
+	if (fwrite(&hdr, sizeof(hdr), 1, bin) != 1)
+	    fatal("fwrite");
+	fflush(bin);
+	fseek(bin, 0, SEEK_END);
+    }
+}
+
+static void fatal(char *msg)
+{
+    perror(msg);
+    exit(1);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: gentrace [-h] [-o <name>] [-f rep|bin|both] [-s <seed>] [-m <max>] [-c]\n");
+    fprintf(stderr, "                [-n <ops>] [-S <dist>] [-L <dist>] [-R <grow>] [-p ...]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-o <name>  Write <name>.rep and/or <name>.bin (default gen).\n");
+    fprintf(stderr, "\t-f <fmt>   Write the text (rep), binary (bin) or both formats (default).\n");
+    fprintf(stderr, "\t-s <seed>  Seed the generator, nonzero (default 1).\n");
+    fprintf(stderr, "\t-m <max>   Clamp request sizes to <max> bytes (default 1048576).\n");
+    fprintf(stderr, "\t-c         Give the allocations of each phase its number as call site.\n");
+    fprintf(stderr, "Phase options; -p starts a new phase with the same settings\n");
+    fprintf(stderr, "\t-n <ops>   Ops in this phase, not counting the final frees (default 100000).\n");
+    fprintf(stderr, "\t-S <dist>  Request sizes (default uniform:1:4096).\n");
+    fprintf(stderr, "\t-L <dist>  Lifetimes, in allocations (default exp:1000).\n");
+    fprintf(stderr, "\t-R <grow>  Realloc a live object with probability p per op:\n");
+    fprintf(stderr, "\t           <p>:mul:<factor> or <p>:add:<bytes> (default none).\n");
+    fprintf(stderr, "Distributions\n");
+    fprintf(stderr, "\tfixed:<n>  uniform:<lo>:<hi>  exp:<mean>  zipf:<s>:<n>[:<unit>]\n");
+    fprintf(stderr, "\tbimodal:<a>:<b>:<p>  hist:<file of \"<value> <weight>\" lines>\n");
+    exit(1);
+}